@@ -0,0 +1,33 @@
+// Encode time and size of every output format on rendered frames.
+// usage: bench_writers [frame.tga ...]   (defaults to output.tga and zbuffer.tga)
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include "imagewriter.h"
+
+int main(int argc, char **argv) {
+    std::vector<const char *> frames;
+    for (int i=1; i<argc; i++) frames.push_back(argv[i]);
+    if (frames.empty()) frames = {"output.tga", "zbuffer.tga"};
+    const char *formats[] = {"x.tga", "x.qoi", "x.ppm", "x.pam"};
+    const int repeats = 10;
+    for (const char *frame : frames) {
+        TGAImage img;
+        if (!img.read_tga_file(frame)) continue;
+        unsigned long raw = (unsigned long)img.get_width()*img.get_height()*img.get_bytespp();
+        std::cout << frame << " " << img.get_width() << "x" << img.get_height() << "/" << img.get_bytespp()*8 << "\n";
+        for (const char *format : formats) {
+            ImageWriter *writer = ImageWriter::for_file(format);
+            std::vector<unsigned char> out;
+            writer->encode(img, out); // warm up
+            auto start = std::chrono::steady_clock::now();
+            for (int k=0; k<repeats; k++) writer->encode(img, out);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()-start).count()/repeats;
+            std::cout << "  " << std::setw(4) << writer->name() << std::fixed << std::setprecision(2)
+                      << std::setw(9) << ms << " ms " << std::setw(10) << out.size() << " bytes "
+                      << std::setw(6) << 100.*out.size()/raw << "%\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <limits>
+#include "bvh.h"
+#include "threadpool.h"
+
+namespace {
+
+const int kBins = 12;
+const int kLeafSize = 4;
+
+struct Box {
+    Vec3f bmin, bmax;
+    Box() : bmin( std::numeric_limits<float>::max(),  std::numeric_limits<float>::max(),  std::numeric_limits<float>::max()),
+            bmax(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()) {}
+    void grow(const Vec3f &p) {
+        for (int i=0; i<3; i++) {
+            bmin[i] = std::min(bmin[i], p[i]);
+            bmax[i] = std::max(bmax[i], p[i]);
+        }
+    }
+    void grow(const Box &b) { grow(b.bmin); grow(b.bmax); }
+    float area() const {
+        Vec3f d = bmax-bmin;
+        if (d.x<0) return 0;
+        return 2.f*(d.x*d.y + d.y*d.z + d.z*d.x);
+    }
+};
+
+struct Builder {
+    std::vector<Box> boxes;
+    std::vector<Vec3f> centroids;
+    std::vector<int> &order;
+
+    Builder(std::vector<int> &o) : boxes(), centroids(), order(o) {}
+
+    // splits order[begin,end) in place, returns the split position or -1 for a leaf
+    int split(int begin, int end, Box &bounds) {
+        Box cbounds;
+        for (int i=begin; i<end; i++) {
+            bounds.grow(boxes[order[i]]);
+            cbounds.grow(centroids[order[i]]);
+        }
+        int n = end-begin;
+        if (n<=kLeafSize) return -1;
+        Vec3f extent = cbounds.bmax-cbounds.bmin;
+        int axis = extent.x>extent.y ? (extent.x>extent.z ? 0 : 2) : (extent.y>extent.z ? 1 : 2);
+        if (extent[axis]<=0) return -1; // all centroids coincide
+
+        Box bins[kBins];
+        int counts[kBins] = {0};
+        float scale = kBins/extent[axis];
+        auto bin_of = [&](int f) { return std::min(kBins-1, (int)((centroids[f][axis]-cbounds.bmin[axis])*scale)); };
+        for (int i=begin; i<end; i++) {
+            int b = bin_of(order[i]);
+            counts[b]++;
+            bins[b].grow(boxes[order[i]]);
+        }
+        // sweep from both sides to evaluate the SAH of every bin boundary
+        float right_area[kBins];
+        int right_count[kBins];
+        Box acc;
+        int cnt = 0;
+        for (int b=kBins-1; b>0; b--) {
+            acc.grow(bins[b]);
+            cnt += counts[b];
+            right_area[b] = acc.area();
+            right_count[b] = cnt;
+        }
+        acc = Box();
+        cnt = 0;
+        float best_cost = std::numeric_limits<float>::max();
+        int best_bin = -1;
+        for (int b=1; b<kBins; b++) {
+            acc.grow(bins[b-1]);
+            cnt += counts[b-1];
+            if (!cnt || !right_count[b]) continue;
+            float cost = acc.area()*cnt + right_area[b]*right_count[b];
+            if (cost<best_cost) { best_cost = cost; best_bin = b; }
+        }
+        if (best_bin<0) return -1;
+        float leaf_cost = bounds.area()*n;
+        if (best_cost>=leaf_cost && n<=kLeafSize*4) return -1; // splitting does not pay off
+        int *mid = std::partition(order.data()+begin, order.data()+end, [&](int f) { return bin_of(f)<best_bin; });
+        return (int)(mid-order.data());
+    }
+
+    // builds the subtree of order[begin,end) with its root at nodes[root]
+    void build(std::vector<BVH::Node> &nodes, int root, int begin, int end) {
+        Box bounds;
+        int mid = split(begin, end, bounds);
+        nodes[root].bmin = bounds.bmin;
+        nodes[root].bmax = bounds.bmax;
+        if (mid<0) {
+            nodes[root].start = begin;
+            nodes[root].count = end-begin;
+            return;
+        }
+        int left = (int)nodes.size();
+        nodes.resize(left+2);
+        nodes[root].start = left;
+        nodes[root].count = 0;
+        build(nodes, left,   begin, mid);
+        build(nodes, left+1, mid,   end);
+    }
+};
+
+bool ray_triangle(const Vec3f &orig, const Vec3f &dir, const Vec3f *tri, float &t, Vec3f &bar) {
+    Vec3f e1 = tri[1]-tri[0], e2 = tri[2]-tri[0];
+    Vec3f p = cross(dir, e2);
+    float det = e1*p;
+    if (std::abs(det)<1e-12f) return false;
+    float inv = 1.f/det;
+    Vec3f s = orig-tri[0];
+    float u = (s*p)*inv;
+    if (u<0 || u>1) return false;
+    Vec3f q = cross(s, e1);
+    float v = (dir*q)*inv;
+    if (v<0 || u+v>1) return false;
+    t = (e2*q)*inv;
+    bar = Vec3f(1-u-v, u, v);
+    return t>0;
+}
+
+bool ray_box(const Vec3f &orig, const Vec3f &inv_dir, const Vec3f &bmin, const Vec3f &bmax, float tmax) {
+    float t0 = 0, t1 = tmax;
+    for (int i=0; i<3; i++) {
+        float a = (bmin[i]-orig[i])*inv_dir[i];
+        float b = (bmax[i]-orig[i])*inv_dir[i];
+        if (a>b) std::swap(a, b);
+        t0 = std::max(t0, a);
+        t1 = std::min(t1, b);
+        if (t0>t1) return false;
+    }
+    return true;
+}
+
+}
+
+BVH::BVH() : nodes_(), faces_(), tris_(), corners_() {
+}
+
+bool BVH::empty() {
+    return nodes_.empty();
+}
+
+int BVH::nnodes() {
+    return (int)nodes_.size();
+}
+
+void BVH::build(const std::vector<Vec3f> &verts, const std::vector<Vec3i> &faces) {
+    int nfaces = (int)faces.size()/3;
+    nodes_.clear();
+    faces_.resize(nfaces);
+    if (!nfaces) return;
+    Builder builder(faces_);
+    builder.boxes.resize(nfaces);
+    builder.centroids.resize(nfaces);
+    for (int f=0; f<nfaces; f++) {
+        faces_[f] = f;
+        for (int k=0; k<3; k++) builder.boxes[f].grow(verts[faces[f*3+k][0]]);
+        builder.centroids[f] = (builder.boxes[f].bmin+builder.boxes[f].bmax)*.5f;
+    }
+
+    // the top levels are split serially until there are enough subtrees to keep the pool busy,
+    // the subtrees are then built in parallel into private arrays and spliced in
+    struct Task { int root, begin, end; };
+    std::vector<Task> tasks, next;
+    nodes_.resize(1);
+    tasks.push_back({0, 0, nfaces});
+    int wanted = ThreadPool::instance().size()*4;
+    while ((int)tasks.size()<wanted && nfaces>4096) {
+        next.clear();
+        for (size_t i=0; i<tasks.size(); i++) {
+            Task t = tasks[i];
+            Box bounds;
+            int mid = builder.split(t.begin, t.end, bounds);
+            nodes_[t.root].bmin = bounds.bmin;
+            nodes_[t.root].bmax = bounds.bmax;
+            if (mid<0) {
+                nodes_[t.root].start = t.begin;
+                nodes_[t.root].count = t.end-t.begin;
+                continue;
+            }
+            int left = (int)nodes_.size();
+            nodes_.resize(left+2);
+            nodes_[t.root].start = left;
+            nodes_[t.root].count = 0;
+            next.push_back({left,   t.begin, mid});
+            next.push_back({left+1, mid,     t.end});
+        }
+        if (next.empty()) break;
+        tasks.swap(next);
+        if ((int)tasks.size()*2>nfaces/kLeafSize) break;
+    }
+    std::vector<std::vector<Node> > subtrees(tasks.size());
+    ThreadPool::instance().parallel_for((int)tasks.size(), [&](int i) {
+        subtrees[i].resize(1);
+        builder.build(subtrees[i], 0, tasks[i].begin, tasks[i].end);
+    });
+    for (size_t i=0; i<tasks.size(); i++) {
+        std::vector<Node> &sub = subtrees[i];
+        int base = (int)nodes_.size() - 1; // local index j>0 goes to base+j
+        for (size_t j=0; j<sub.size(); j++)
+            if (!sub[j].count) sub[j].start += base;
+        nodes_[tasks[i].root] = sub[0];
+        nodes_.insert(nodes_.end(), sub.begin()+1, sub.end());
+    }
+
+    tris_.resize(nfaces*3);
+    for (int i=0; i<nfaces; i++)
+        for (int k=0; k<3; k++) tris_[i*3+k] = verts[faces[faces_[i]*3+k][0]];
+}
+
+void BVH::drop_triangles(Corners corners) {
+    if (!corners) return;
+    corners_ = corners;
+    std::vector<Vec3f>().swap(tris_);
+}
+
+size_t BVH::bytes() {
+    return nodes_.size()*sizeof(Node) + faces_.size()*sizeof(int) + tris_.size()*sizeof(Vec3f);
+}
+
+int BVH::intersect(Vec3f orig, Vec3f dir, float &t, Vec3f &bar) {
+    int hit = -1;
+    t = std::numeric_limits<float>::max();
+    if (nodes_.empty()) return hit;
+    Vec3f inv_dir;
+    for (int i=0; i<3; i++) inv_dir[i] = dir[i]!=0 ? 1.f/dir[i] : std::numeric_limits<float>::max();
+    std::vector<int> stack(1, 0);
+    stack.reserve(64);
+    while (!stack.empty()) {
+        const Node &n = nodes_[stack.back()];
+        stack.pop_back();
+        if (!ray_box(orig, inv_dir, n.bmin, n.bmax, t)) continue;
+        if (n.count) {
+            for (int i=n.start; i<n.start+n.count; i++) {
+                float ti;
+                Vec3f b;
+                Vec3f fetched[3];
+                const Vec3f *tri = &fetched[0];
+                if (tris_.empty()) corners_(faces_[i], fetched);
+                else tri = &tris_[i*3];
+                if (ray_triangle(orig, dir, tri, ti, b) && ti<t) {
+                    t = ti;
+                    bar = b;
+                    hit = faces_[i];
+                }
+            }
+        } else {
+            stack.push_back(n.start);
+            stack.push_back(n.start+1);
+        }
+    }
+    return hit;
+}
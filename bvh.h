@@ -0,0 +1,38 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include <vector>
+#include <functional>
+#include "geometry.h"
+
+// Bounding volume hierarchy over the triangles of a mesh, built with the
+// binned surface area heuristic. Nodes live in one flat array, the two
+// children of an interior node are stored next to each other.
+class BVH {
+public:
+    struct Node {
+        Vec3f bmin, bmax;
+        int start; // leaf: first entry in faces_, interior: index of the left child
+        int count; // number of triangles of a leaf, 0 for interior nodes
+    };
+    typedef std::function<void(int face, Vec3f tri[3])> Corners;
+private:
+    std::vector<Node> nodes_;
+    std::vector<int> faces_;   // face indices in leaf order
+    std::vector<Vec3f> tris_;  // the 3 corners of every entry of faces_, for ray tests
+    Corners corners_;          // replaces tris_ after drop_triangles()
+public:
+    BVH();
+    // faces is a Model style triangle index buffer (vertex/uv/normal corners)
+    void build(const std::vector<Vec3f> &verts, const std::vector<Vec3i> &faces);
+    bool empty();
+    int nnodes();
+    // frees the float copy of the triangles, ray tests then ask corners for them
+    void drop_triangles(Corners corners);
+    size_t bytes();
+    // closest triangle hit by orig+t*dir, t>0; returns its face index or -1,
+    // fills the distance and the barycentric coordinates of the hit
+    int intersect(Vec3f orig, Vec3f dir, float &t, Vec3f &bar);
+};
+
+#endif //__BVH_H__
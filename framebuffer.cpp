@@ -0,0 +1,60 @@
+#include <cstring>
+#include <algorithm>
+#include "framebuffer.h"
+#include "threadpool.h"
+
+namespace {
+
+const unsigned long kClearBlock = 256<<10; // bytes per clear task
+
+//through a view, not buffer(): a vertical flip stays a flag instead of reversing every row first
+void parallel_clear(TGAImage &img) {
+    ImageView v = img.view();
+    if (v.empty()) return;
+    unsigned long row_bytes = (unsigned long)v.width*v.bytespp;
+    int rows = (int)std::max(1ul, kClearBlock/row_bytes);
+    int nblocks = (v.height+rows-1)/rows;
+    ThreadPool::instance().parallel_for(nblocks, [v, rows, row_bytes](int k) {
+        int last = std::min(v.height, (k+1)*rows);
+        for (int y=k*rows; y<last; y++) memset(v.row(y), 0, row_bytes);
+    });
+}
+
+}
+
+Framebuffer::Framebuffer() : color_(), depth_(), hdr_() {
+}
+
+bool Framebuffer::resize(int w, int h) {
+    if (w==color_.get_width() && h==color_.get_height()) return false;
+    color_ = TGAImage(w, h, TGAImage::RGB);
+    depth_ = TGAImage(w, h, TGAImage::GRAYSCALE);
+    hdr_ = HdrImage(w, h);
+    return true;
+}
+
+void Framebuffer::clear() {
+    parallel_clear(color_);
+    parallel_clear(depth_);
+    hdr_.clear();
+}
+
+int Framebuffer::width() {
+    return color_.get_width();
+}
+
+int Framebuffer::height() {
+    return color_.get_height();
+}
+
+TGAImage &Framebuffer::color() {
+    return color_;
+}
+
+TGAImage &Framebuffer::depth() {
+    return depth_;
+}
+
+HdrImage &Framebuffer::hdr() {
+    return hdr_;
+}
@@ -0,0 +1,25 @@
+#ifndef __FRAMEBUFFER_H__
+#define __FRAMEBUFFER_H__
+
+#include "tgaimage.h"
+#include "hdr.h"
+
+// Color (8-bit output and linear HDR) and depth targets kept across frames: storage is reallocated only
+// when the size changes and cleared in parallel at the start of a frame.
+class Framebuffer {
+private:
+    TGAImage color_;
+    TGAImage depth_;
+    HdrImage hdr_;
+public:
+    Framebuffer();
+    bool resize(int w, int h); // true if the targets were reallocated
+    void clear();
+    int width();
+    int height();
+    TGAImage &color();
+    TGAImage &depth();
+    HdrImage &hdr(); // resolved into color() at the end of a frame
+};
+
+#endif //__FRAMEBUFFER_H__
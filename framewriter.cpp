@@ -0,0 +1,72 @@
+#include <iostream>
+#include "framewriter.h"
+#include "imagewriter.h"
+#include "threadpool.h"
+
+FrameWriter::FrameWriter(size_t capacity) : queue_(), spares_(), capacity_(capacity ? capacity : 1), pending_(0), stop_(false),
+                                            mutex_(), work_(), done_(), thread_() {
+    ThreadPool::instance(); // the encoders use the pool, it has to outlive this writer
+    thread_ = std::thread(&FrameWriter::run, this);
+}
+
+FrameWriter::~FrameWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_.notify_all();
+    thread_.join();
+}
+
+void FrameWriter::run() {
+    while (true) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            work_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) return; // stopping, everything is written
+            job = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        if (!write_image(job.image, job.filename.c_str()))
+            std::cerr << "can't write frame " << job.filename << "\n";
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (spares_.size()<capacity_+1) spares_.push_back(std::move(job.image));
+            pending_--;
+        }
+        done_.notify_all();
+    }
+}
+
+TGAImage FrameWriter::spare(int w, int h, int bpp) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i=0; i<spares_.size(); i++) {
+        TGAImage &img = spares_[i];
+        if (img.get_width()!=w || img.get_height()!=h || img.get_bytespp()!=bpp) continue;
+        TGAImage res = std::move(img);
+        spares_.erase(spares_.begin()+i);
+        return res;
+    }
+    for (size_t i=spares_.size(); i--; ) // the frame size changed, the old ones are of no use
+        if (spares_[i].get_width()!=w || spares_[i].get_height()!=h) spares_.erase(spares_.begin()+i);
+    return TGAImage(w, h, bpp);
+}
+
+void FrameWriter::submit(TGAImage &&frame, const std::string &filename) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this]() { return queue_.size()<capacity_; }); // backpressure
+        Job job;
+        job.image = std::move(frame);
+        job.filename = filename;
+        queue_.push_back(std::move(job));
+        pending_++;
+    }
+    work_.notify_one();
+}
+
+void FrameWriter::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() { return !pending_; });
+}
@@ -0,0 +1,41 @@
+#ifndef __FRAMEWRITER_H__
+#define __FRAMEWRITER_H__
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "tgaimage.h"
+
+// Background thread that encodes and saves finished frames (see imagewriter.h
+// for the formats). The queue is bounded: submit() blocks while it is full, so
+// a renderer that outpaces the disk is slowed down instead of piling up frames.
+// Written images are kept as spares and handed back by spare(), so a steady
+// frame loop does not allocate.
+class FrameWriter {
+private:
+    struct Job {
+        TGAImage image;
+        std::string filename;
+    };
+    std::deque<Job> queue_;
+    std::vector<TGAImage> spares_;
+    size_t capacity_;
+    int pending_;  // queued or being written
+    bool stop_;
+    std::mutex mutex_;
+    std::condition_variable work_; // the writer waits for jobs
+    std::condition_variable done_; // producers wait for room, flush() for completion
+    std::thread thread_;
+    void run();
+public:
+    FrameWriter(size_t capacity=2);
+    ~FrameWriter(); // writes what is still queued
+    TGAImage spare(int w, int h, int bpp); // a recycled image of that size, contents undefined
+    void submit(TGAImage &&frame, const std::string &filename);
+    void flush(); // waits until every submitted frame is on disk
+};
+
+#endif //__FRAMEWRITER_H__
@@ -171,6 +171,16 @@ public:
         T tmp = ret[0]*rows[0];
         return ret/tmp;
     }
+
+    mat<DimRows,DimCols,T> invert() {
+        return invert_transpose().transpose();
+    }
+
+    mat<DimCols,DimRows,T> transpose() {
+        mat<DimCols,DimRows,T> ret;
+        for (size_t i=DimCols; i--; ret[i]=this->col(i));
+        return ret;
+    }
 };
 
 /////////////////////////////////////////////////////////////////////////////////
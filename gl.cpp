@@ -84,6 +84,20 @@ void viewport(int x, int y, int w, int h) {
     Viewport[1][1] = h / 2.f;
     Viewport[2][2] = 255 / 2.f;
 }
+
+float screenExtent(Vec3f bmin, Vec3f bmax, Matrix M) {
+    Vec2f lo( std::numeric_limits<float>::max(),  std::numeric_limits<float>::max());
+    Vec2f hi(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
+    for (int i=0; i<8; i++) {
+        Vec3f corner(i&1 ? bmax.x : bmin.x, i&2 ? bmax.y : bmin.y, i&4 ? bmax.z : bmin.z);
+        Vec4f p = M*embed<4>(corner);
+        for (int j=0; j<2; j++) {
+            lo[j] = std::min(lo[j], p[j]/p[3]);
+            hi[j] = std::max(hi[j], p[j]/p[3]);
+        }
+    }
+    return std::max(hi.x-lo.x, hi.y-lo.y);
+}
 //{
 //    Matrix m = Matrix::identity(4);
 //    //Translation
@@ -104,7 +118,7 @@ const TGAColor green = TGAColor(0, 255, 0, 255);
 const TGAColor blue = TGAColor(0, 0, 255, 255);
 
 
-Vec3f baryCentric(std::vector<Vec2f> tri, Vec2f P) {
+Vec3f baryCentric(const std::vector<Vec2f> &tri, Vec2f P) {
     auto A = tri[0], B = tri[1], C = tri[2];
     Vec3f s[2];
     for (int i=2; i--; ) {
@@ -138,8 +152,8 @@ template<size_t LEN,size_t DIM, typename T> vec<LEN,T> proj(const vec<DIM,T> &v)
 */
 
 
-void drawTriangle(Vec4f tri[3], IShader *shader,
-                  TGAImage &image, TGAImage &zbuffer) {
+//shade(P, bc) runs the fragment shader and writes the color, false when discarded
+template<class Shade> static void rasterize(Vec4f tri[3], TGAImage &zbuffer, Shade shade) {
     //here pts is screen coords
 //    Vec2f bboxmin(image.get_width()-1,  image.get_height()-1);
 //    Vec2f bboxmax(0, 0);
@@ -162,9 +176,9 @@ void drawTriangle(Vec4f tri[3], IShader *shader,
     }
 
     Vec2i P;
+    std::vector<Vec2f> tri2D = {proj<2>(tri[0]/tri[0][3]), proj<2>(tri[1]/tri[1][3]), proj<2>(tri[2]/tri[2][3])};
     for (P.x=bboxmin.x; P.x<=bboxmax.x; P.x++) {
         for (P.y=bboxmin.y; P.y<=bboxmax.y; P.y++) {
-            std::vector<Vec2f> tri2D = {proj<2>(tri[0]/tri[0][3]), proj<2>(tri[1]/tri[1][3]), proj<2>(tri[2]/tri[2][3])};
             Vec3f bc  = baryCentric(tri2D, P);
             if (bc.x<0 || bc.y<0 || bc.z<0) continue;
 
@@ -178,15 +192,30 @@ void drawTriangle(Vec4f tri[3], IShader *shader,
             //zbuffer.get虽然是TGA Color类型，但作为zbuffer时不表示color，而是深度etc
             if (bc.x < 0 || bc.y < 0 || bc.z < 0 || frag_depth < zbuffer.get(P.x, P.y)[0])
                 continue;
-            TGAColor color;
-            bool discard = shader->fragment(bc, color);
-            if (!discard) {
-                zbuffer.set(P.x, P.y, TGAColor(frag_depth));
-                image.set(P.x, P.y, color);
-            }
+            if (shade(P, bc)) zbuffer.set(P.x, P.y, TGAColor(frag_depth));
         }
     }
 }
+
+void drawTriangle(Vec4f tri[3], IShader *shader,
+                  TGAImage &image, TGAImage &zbuffer) {
+    rasterize(tri, zbuffer, [&](Vec2i P, Vec3f bc) {
+        TGAColor color;
+        if (shader->fragment(bc, color)) return false;
+        image.set(P.x, P.y, color);
+        return true;
+    });
+}
+
+void drawTriangle(Vec4f tri[3], IShader *shader,
+                  HdrImage &image, TGAImage &zbuffer) {
+    rasterize(tri, zbuffer, [&](Vec2i P, Vec3f bc) {
+        Vec3f color;
+        if (shader->fragment_hdr(bc, color)) return false;
+        image.set(P.x, P.y, color);
+        return true;
+    });
+}
 //
 //void drawTriangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer) {
 //    Vec2f bboxmin( std::numeric_limits<float>::max(),  std::numeric_limits<float>::max());
@@ -4,6 +4,7 @@
 #include "tgaimage.h"
 #include "geometry.h"
 #include "model.h"
+#include "hdr.h"
 
 extern Matrix ModelView, Projection, Viewport;
 extern Model *model;
@@ -20,6 +21,9 @@ void lookat(Vec3f eye, Vec3f center, Vec3f up); //modelview
 void projection(Vec3f eye, Vec3f center);
 void viewport(int x, int y, int w, int h);
 
+//largest side, in pixels, of the screen rectangle covered by a box under transform M (viewport included)
+float screenExtent(Vec3f bmin, Vec3f bmax, Matrix M);
+
 
 struct IShader {
     virtual ~IShader() {}
@@ -29,6 +33,13 @@ struct IShader {
     mat<4,4,float> uniform_MIT; // (Projection*ModelView).invert_transpose()
     virtual Vec4f  vertex(int iface, int nthvert) = 0;
     virtual bool fragment(Vec3f bar, TGAColor &color) = 0;
+    //linear unclamped RGB for the HDR target, by default the 8-bit result decoded from sRGB
+    virtual bool fragment_hdr(Vec3f bar, Vec3f &color) {
+        TGAColor c;
+        bool discard = fragment(bar, c);
+        color = linear_rgb(c);
+        return discard;
+    }
 };
 
 
@@ -125,6 +136,19 @@ struct PhoneShader : public IShader {
         for (int i=0; i<3; i++) color[i] = std::min<float>(5 + c[i]*(diff + .6*spec), 255);
         return false;
     }
+
+    //same lighting in linear space, highlights are left to the tone mapper
+    virtual bool fragment_hdr(Vec3f bar, Vec3f &color) {
+        Vec2f uv = varying_uv*bar;
+        Vec3f n = proj<3>(uniform_MIT*embed<4>(model->normal(uv))).normalize();
+        Vec3f l = proj<3>(uniform_M  *embed<4>(light_dir        )).normalize();
+        Vec3f r = (n*(n*l*2.f) - l).normalize();
+        float spec = pow(std::max(r.z, 0.0f), model->specular(uv));
+        float diff = std::max(0.f, n*l);
+        float ambient = srgb_to_linear(5);
+        color = linear_rgb(model->diffuse(uv))*(diff + .6f*spec) + Vec3f(ambient, ambient, ambient);
+        return false;
+    }
 };
 
 struct LighterPhoneShader : public IShader {
@@ -149,6 +173,18 @@ struct LighterPhoneShader : public IShader {
         for (int i=0; i<3; i++) color[i] = std::min<float>(10 + c[i]*(2 * diff + 1.5*spec), 255);
         return false;
     }
+
+    virtual bool fragment_hdr(Vec3f bar, Vec3f &color) {
+        Vec2f uv = varying_uv*bar;
+        Vec3f n = proj<3>(uniform_MIT*embed<4>(model->normal(uv))).normalize();
+        Vec3f l = proj<3>(uniform_M  *embed<4>(light_dir        )).normalize();
+        Vec3f r = (n*(n*l*2.f) - l).normalize();
+        float spec = pow(std::max(r.z, 0.0f), model->specular(uv));
+        float diff = std::max(0.f, n*l);
+        float ambient = srgb_to_linear(10);
+        color = linear_rgb(model->diffuse(uv))*(2*diff + 1.5f*spec) + Vec3f(ambient, ambient, ambient);
+        return false;
+    }
 };
 
 
@@ -158,6 +194,9 @@ struct LighterPhoneShader : public IShader {
 // 2024 05 12 Reconstruction
 void drawTriangle(Vec4f pts[3], IShader *shader,
                   TGAImage &image, TGAImage &zbuffer);
+//same, shading through fragment_hdr into a float target
+void drawTriangle(Vec4f pts[3], IShader *shader,
+                  HdrImage &image, TGAImage &zbuffer);
 //    Vec2f bboxmin(image.get_width()-1,  image.get_height()-1);
 //    Vec2f bboxmax(0, 0);
 //    Vec2f clamp(image.get_width()-1, image.get_height()-1);
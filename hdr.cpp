@@ -0,0 +1,128 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "hdr.h"
+#include "threadpool.h"
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const int kEncodeSize = 4096; // linear [0,1] quantization of the sRGB encode LUT
+const int kRowsPerTask = 16;
+
+float srgb_decode(float c) {
+    return c<=.04045f ? c/12.92f : std::pow((c+.055f)/1.055f, 2.4f);
+}
+
+float srgb_encode(float c) {
+    return c<=.0031308f ? c*12.92f : 1.055f*std::pow(c, 1.f/2.4f)-.055f;
+}
+
+const unsigned char *srgb_encode_lut() {
+    static unsigned char lut[kEncodeSize];
+    static bool ready = [](){
+        for (int i=0; i<kEncodeSize; i++) lut[i] = (unsigned char)(255.f*srgb_encode(i/(kEncodeSize-1.f))+.5f);
+        return true;
+    }();
+    (void)ready;
+    return lut;
+}
+
+// tone curve, exposure and quantization of n floats into LUT indices
+void tonemap(const float *in, int n, ToneMap op, float exposure, int *idx) {
+    int i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128 e = _mm_set1_ps(exposure), one = _mm_set1_ps(1.f), zero = _mm_setzero_ps();
+    const __m128 scale = _mm_set1_ps(kEncodeSize-1.f);
+    for (; i+4<=n; i+=4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(in+i), e);
+        x = _mm_max_ps(x, zero);
+        if (TONEMAP_REINHARD==op) {
+            x = _mm_div_ps(x, _mm_add_ps(one, x));
+        } else if (TONEMAP_ACES==op) {
+            __m128 num = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.51f)), _mm_set1_ps(.03f)));
+            __m128 den = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(2.43f)), _mm_set1_ps(.59f))), _mm_set1_ps(.14f));
+            x = _mm_div_ps(num, den);
+        }
+        x = _mm_min_ps(x, one);
+        _mm_storeu_si128((__m128i *)(idx+i), _mm_cvtps_epi32(_mm_mul_ps(x, scale))); // rounds to nearest
+    }
+#endif
+    for (; i<n; i++) {
+        float x = std::max(0.f, in[i]*exposure);
+        if (TONEMAP_REINHARD==op) x = x/(1.f+x);
+        else if (TONEMAP_ACES==op) x = x*(2.51f*x+.03f)/(x*(2.43f*x+.59f)+.14f);
+        idx[i] = (int)(std::min(x, 1.f)*(kEncodeSize-1.f)+.5f);
+    }
+}
+
+}
+
+const float *srgb_decode_lut() {
+    static float lut[256];
+    static bool ready = [](){
+        for (int i=0; i<256; i++) lut[i] = srgb_decode(i/255.f);
+        return true;
+    }();
+    (void)ready;
+    return lut;
+}
+
+HdrImage::HdrImage() : rgb_(), width_(0), height_(0) {
+}
+
+HdrImage::HdrImage(int w, int h) : rgb_((size_t)w*h*3, 0.f), width_(w), height_(h) {
+}
+
+int HdrImage::get_width() {
+    return width_;
+}
+
+int HdrImage::get_height() {
+    return height_;
+}
+
+float *HdrImage::row(int y) {
+    return &rgb_[(size_t)y*width_*3];
+}
+
+bool HdrImage::set(int x, int y, const Vec3f &c) {
+    if (x<0 || y<0 || x>=width_ || y>=height_) return false;
+    float *p = row(y)+x*3;
+    p[0] = c.x;
+    p[1] = c.y;
+    p[2] = c.z;
+    return true;
+}
+
+void HdrImage::clear() {
+    int ntasks = (height_+kRowsPerTask-1)/kRowsPerTask;
+    ThreadPool::instance().parallel_for(ntasks, [this](int task) {
+        int first = task*kRowsPerTask, end = std::min(height_, first+kRowsPerTask);
+        memset(row(first), 0, (size_t)(end-first)*width_*3*sizeof(float));
+    });
+}
+
+bool resolve(HdrImage &hdr, const ImageView &out, ToneMap op, float exposure) {
+    int w = hdr.get_width(), h = hdr.get_height();
+    if (out.width!=w || out.height!=h || out.bytespp<3) return false;
+    const unsigned char *encode = srgb_encode_lut();
+    int ntasks = (h+kRowsPerTask-1)/kRowsPerTask;
+    ThreadPool::instance().parallel_for(ntasks, [&](int task) {
+        std::vector<int> idx((size_t)w*3);
+        int end = std::min(h, (task+1)*kRowsPerTask);
+        for (int y=task*kRowsPerTask; y<end; y++) {
+            tonemap(hdr.row(y), w*3, op, exposure, idx.data());
+            unsigned char *dst = out.row(y);
+            for (int x=0; x<w; x++, dst+=out.bytespp) { // RGB to BGR(A)
+                dst[0] = encode[idx[x*3+2]];
+                dst[1] = encode[idx[x*3+1]];
+                dst[2] = encode[idx[x*3+0]];
+                if (4==out.bytespp) dst[3] = 255;
+            }
+        }
+    });
+    return true;
+}
@@ -0,0 +1,47 @@
+#ifndef __HDR_H__
+#define __HDR_H__
+
+#include <vector>
+#include "geometry.h"
+#include "tgaimage.h"
+
+// Linear float RGB render target. Shaders write unclamped radiance through
+// IShader::fragment_hdr; resolve() tone-maps it into an 8-bit sRGB image.
+class HdrImage {
+private:
+    std::vector<float> rgb_; // 3 floats per pixel, rows top to bottom
+    int width_;
+    int height_;
+public:
+    HdrImage();
+    HdrImage(int w, int h);
+    int get_width();
+    int get_height();
+    float *row(int y);
+    bool set(int x, int y, const Vec3f &c);
+    void clear(); // parallel
+};
+
+enum ToneMap {
+    TONEMAP_CLAMP,    // plain saturation, LDR content is unchanged
+    TONEMAP_REINHARD, // x/(1+x)
+    TONEMAP_ACES      // Narkowicz's fit of the ACES filmic curve
+};
+
+const float *srgb_decode_lut(); // 256 entries, sRGB byte to linear
+
+inline float srgb_to_linear(unsigned char v) {
+    static const float *lut = srgb_decode_lut();
+    return lut[v];
+}
+
+// a TGAColor (BGR order, sRGB) as linear RGB
+inline Vec3f linear_rgb(TGAColor c) {
+    return Vec3f(srgb_to_linear(c[2]), srgb_to_linear(c[1]), srgb_to_linear(c[0]));
+}
+
+// exposure scale, tone curve and sRGB encode (through a LUT) into out, which must
+// have the size of hdr and 3 or 4 bytes per pixel; rows run in parallel
+bool resolve(HdrImage &hdr, const ImageView &out, ToneMap op, float exposure=1.f);
+
+#endif //__HDR_H__
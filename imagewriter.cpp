@@ -0,0 +1,190 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <cctype>
+#include <stdint.h>
+#include "imagewriter.h"
+
+namespace {
+
+class TgaWriter : public ImageWriter {
+public:
+    const char *name() { return "tga"; }
+    bool encode(TGAImage &img, std::vector<unsigned char> &out) {
+        out.clear();
+        img.encode_tga(out, true);
+        return true;
+    }
+};
+
+// https://qoiformat.org/qoi-specification.pdf
+// pixels are handled as packed little endian RGBA words, dst must hold 5 bytes per pixel
+template<int bpp> unsigned char *qoi_encode(const ImageView &img, unsigned char *dst) {
+    uint32_t index[64];
+    memset(index, 0, sizeof(index));
+    uint32_t prev = 0xff000000u; // r=g=b=0, a=255
+    int run = 0;
+    unsigned long npixels = (unsigned long)img.width*img.height;
+    const unsigned char *p = img.row(0);
+    for (unsigned long i=0, x=0; i<npixels; i++, p+=bpp) {
+        if (x++==(unsigned long)img.width) { // rows need not be contiguous
+            x = 1;
+            p = img.row(i/img.width);
+        }
+        uint32_t px = 1==bpp ? p[0]*0x010101u | 0xff000000u
+                    : (uint32_t)p[2] | p[1]<<8 | p[0]<<16 | (uint32_t)(4==bpp ? p[3] : 255)<<24;
+        if (px==prev) {
+            if (++run==62 || i+1==npixels) {
+                *dst++ = 0xc0 | (run-1); // QOI_OP_RUN
+                run = 0;
+            }
+            continue;
+        }
+        if (run) {
+            *dst++ = 0xc0 | (run-1);
+            run = 0;
+        }
+        unsigned char r = px, g = px>>8, b = px>>16, a = px>>24;
+        int hash = (r*3 + g*5 + b*7 + a*11) & 63;
+        if (index[hash]==px) {
+            *dst++ = hash; // QOI_OP_INDEX
+        } else {
+            index[hash] = px;
+            if (a==(unsigned char)(prev>>24)) {
+                signed char vr = r-(unsigned char)prev;
+                signed char vg = g-(unsigned char)(prev>>8);
+                signed char vb = b-(unsigned char)(prev>>16);
+                signed char vg_r = vr-vg;
+                signed char vg_b = vb-vg;
+                if (vr>-3 && vr<2 && vg>-3 && vg<2 && vb>-3 && vb<2) {
+                    *dst++ = 0x40 | (vr+2)<<4 | (vg+2)<<2 | (vb+2); // QOI_OP_DIFF
+                } else if (vg_r>-9 && vg_r<8 && vg>-33 && vg<32 && vg_b>-9 && vg_b<8) {
+                    *dst++ = 0x80 | (vg+32); // QOI_OP_LUMA
+                    *dst++ = (vg_r+8)<<4 | (vg_b+8);
+                } else {
+                    *dst++ = 0xfe; // QOI_OP_RGB
+                    *dst++ = r;
+                    *dst++ = g;
+                    *dst++ = b;
+                }
+            } else {
+                *dst++ = 0xff; // QOI_OP_RGBA
+                *dst++ = r;
+                *dst++ = g;
+                *dst++ = b;
+                *dst++ = a;
+            }
+        }
+        prev = px;
+    }
+    return dst;
+}
+
+class QoiWriter : public ImageWriter {
+public:
+    const char *name() { return "qoi"; }
+    bool encode(TGAImage &img, std::vector<unsigned char> &out) {
+        ImageView view = img.view();
+        unsigned int w = view.width, h = view.height;
+        int bpp = view.bytespp;
+        unsigned long npixels = (unsigned long)w*h;
+        out.resize(14 + npixels*5 + 8); // worst case, trimmed below
+        unsigned char *dst = out.data();
+        const unsigned char header[14] = {'q', 'o', 'i', 'f',
+            (unsigned char)(w>>24), (unsigned char)(w>>16), (unsigned char)(w>>8), (unsigned char)w,
+            (unsigned char)(h>>24), (unsigned char)(h>>16), (unsigned char)(h>>8), (unsigned char)h,
+            (unsigned char)(4==bpp ? 4 : 3), 0}; // channels, sRGB with linear alpha
+        memcpy(dst, header, sizeof(header));
+        dst += sizeof(header);
+        if (1==bpp)      dst = qoi_encode<1>(view, dst);
+        else if (3==bpp) dst = qoi_encode<3>(view, dst);
+        else             dst = qoi_encode<4>(view, dst);
+        const unsigned char padding[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+        memcpy(dst, padding, sizeof(padding));
+        dst += sizeof(padding);
+        out.resize(dst-out.data());
+        return true;
+    }
+};
+
+// netpbm: a text header followed by the raw top-down samples
+class PnmWriter : public ImageWriter {
+    bool pam_;
+public:
+    PnmWriter(bool pam) : pam_(pam) {}
+    const char *name() { return pam_ ? "pam" : "ppm"; }
+    bool encode(TGAImage &img, std::vector<unsigned char> &out) {
+        ImageView view = img.view();
+        int w = view.width, h = view.height, bpp = view.bytespp;
+        int depth = pam_ ? bpp : (1==bpp ? 1 : 3);
+        std::string header;
+        if (pam_) {
+            const char *tupltype = 1==bpp ? "GRAYSCALE" : (3==bpp ? "RGB" : "RGB_ALPHA");
+            header = "P7\nWIDTH " + std::to_string(w) + "\nHEIGHT " + std::to_string(h) + "\nDEPTH " + std::to_string(depth) +
+                     "\nMAXVAL 255\nTUPLTYPE " + tupltype + "\nENDHDR\n";
+        } else {
+            header = std::string(1==depth ? "P5\n" : "P6\n") + std::to_string(w) + " " + std::to_string(h) + "\n255\n";
+        }
+        unsigned long npixels = (unsigned long)w*h;
+        out.resize(header.size() + npixels*depth);
+        memcpy(out.data(), header.data(), header.size());
+        unsigned char *dst = out.data()+header.size();
+        for (int y=0; y<h; y++) {
+            const unsigned char *p = view.row(y);
+            if (1==bpp) {
+                memcpy(dst, p, w);
+                dst += w;
+                continue;
+            }
+            for (int x=0; x<w; x++, p+=bpp, dst+=depth) { // BGR(A) to RGB(A)
+                dst[0] = p[2];
+                dst[1] = p[1];
+                dst[2] = p[0];
+                if (4==depth) dst[3] = p[3];
+            }
+        }
+        return true;
+    }
+};
+
+TgaWriter tgaWriter;
+QoiWriter qoiWriter;
+PnmWriter ppmWriter(false);
+PnmWriter pamWriter(true);
+
+}
+
+bool ImageWriter::write(TGAImage &img, const char *filename) {
+    std::vector<unsigned char> file;
+    if (!img.get_width() || !encode(img, file)) {
+        std::cerr << "can't encode " << filename << "\n";
+        return false;
+    }
+    std::ofstream out(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    out.write((const char *)file.data(), file.size());
+    if (!out.good()) {
+        std::cerr << "can't dump the " << name() << " file\n";
+        return false;
+    }
+    return true;
+}
+
+ImageWriter *ImageWriter::for_file(const char *filename) {
+    std::string ext(filename);
+    size_t dot = ext.find_last_of('.');
+    ext = dot==std::string::npos ? "" : ext.substr(dot+1);
+    for (size_t i=0; i<ext.size(); i++) ext[i] = tolower(ext[i]);
+    if (ext=="qoi") return &qoiWriter;
+    if (ext=="ppm" || ext=="pgm") return &ppmWriter;
+    if (ext=="pam") return &pamWriter;
+    return &tgaWriter;
+}
+
+bool write_image(TGAImage &img, const char *filename) {
+    return ImageWriter::for_file(filename)->write(img, filename);
+}
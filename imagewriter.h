@@ -0,0 +1,23 @@
+#ifndef __IMAGEWRITER_H__
+#define __IMAGEWRITER_H__
+
+#include <vector>
+#include "tgaimage.h"
+
+// Frame output formats, picked by file extension:
+//   .tga        RLE targa (the default for unknown extensions)
+//   .qoi        "Quite OK Image" format, lossless and much cheaper to encode than RLE
+//   .ppm/.pgm   uncompressed netpbm, P6 for color (alpha dropped) or P5 for grayscale
+//   .pam        uncompressed netpbm P7, keeps alpha
+class ImageWriter {
+public:
+    virtual ~ImageWriter() {}
+    virtual const char *name() = 0;
+    virtual bool encode(TGAImage &img, std::vector<unsigned char> &out) = 0; // the whole file
+    bool write(TGAImage &img, const char *filename);                         // encode, then one write
+    static ImageWriter *for_file(const char *filename); // shared stateless instances
+};
+
+bool write_image(TGAImage &img, const char *filename);
+
+#endif //__IMAGEWRITER_H__
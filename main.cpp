@@ -1,6 +1,9 @@
 #include <QApplication>
+#include <QDebug>
 #include <cmath>
 #include <cstdio>
+#include <cstring>
+#include <cstdlib>
 
 #include "widget.h"
 
@@ -8,10 +11,29 @@ using namespace std;
 
 int main(int argc, char** argv) {
     QApplication a(argc, argv);
+    //--compress-models stores meshes quantized, less memory for slightly lossy geometry
+    //--tonemap reinhard|aces rolls off the highlights of the HDR shaders, LDR ones get darker
+    //--save-frames also writes every frame to output.tga and zbuffer.tga
+    //--cull-backfaces drops clusters facing away even on open meshes, whose insides then vanish
+    //all of them before the Widget: its render thread reads these globals from the first frame on
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--compress-models")) compressModels = true;
+        if (!strcmp(argv[i], "--save-frames")) saveFrames = true;
+        if (!strcmp(argv[i], "--cull-backfaces")) cullBackfaces = true;
+        if (!strcmp(argv[i], "--tonemap") && i+1 < argc) {
+            if (!strcmp(argv[i+1], "reinhard")) toneMap = TONEMAP_REINHARD;
+            if (!strcmp(argv[i+1], "aces")) toneMap = TONEMAP_ACES;
+        }
+    }
     Widget w;
     w.resize(1000, 600);
     w.setWindowTitle("Blackbird Renderer");
     w.show();
+    //--stream <obj> [limit in MB] renders a mesh out of core
+    if (argc > 2 && !strcmp(argv[1], "--stream")) {
+        size_t limit = argc > 3 ? atoi(argv[3]) : 256;
+        w.openStream(argv[2], limit<<20);
+    }
     return a.exec();
     //delete model;
     return 0;
@@ -0,0 +1,181 @@
+#include <algorithm>
+#include <limits>
+#include "meshlet.h"
+#include "vcache.h"
+
+namespace {
+
+void finish(Meshlet &m, const std::vector<Vec3f> &verts, const std::vector<Vec3i> &faces, const std::vector<int> &used) {
+    // sphere around the bounding box of the cluster vertices
+    Vec3f bmin = verts[used[0]], bmax = verts[used[0]];
+    for (size_t i=1; i<used.size(); i++)
+        for (int j=0; j<3; j++) {
+            bmin[j] = std::min(bmin[j], verts[used[i]][j]);
+            bmax[j] = std::max(bmax[j], verts[used[i]][j]);
+        }
+    m.center = (bmin+bmax)*.5f;
+    m.radius = 0;
+    for (size_t i=0; i<used.size(); i++) m.radius = std::max(m.radius, (verts[used[i]]-m.center).norm());
+
+    // normal cone: average of the face normals, opened up to the widest one
+    std::vector<Vec3f> normals, points; // unit normal and one corner of every triangle
+    Vec3f axis;
+    for (int f=m.first; f<m.first+m.count; f++) {
+        Vec3f p0 = verts[faces[f*3][0]];
+        Vec3f n = cross(verts[faces[f*3+1][0]]-p0, verts[faces[f*3+2][0]]-p0);
+        float len = n.norm();
+        if (len<=0) continue; // degenerate triangles do not constrain the cone
+        n = n/len;
+        normals.push_back(n);
+        points.push_back(p0);
+        axis = axis + n;
+    }
+    m.cone_apex = m.center;
+    m.cone_axis = Vec3f(0, 0, 1);
+    m.cone_cutoff = 1.f;
+    float alen = axis.norm();
+    if (normals.empty() || alen<=0) return;
+    axis = axis/alen;
+    float mindp = 1.f;
+    for (size_t i=0; i<normals.size(); i++) mindp = std::min(mindp, normals[i]*axis);
+    if (mindp<=.1f) return; // normals spread over more than ~84 degrees, never cull
+    // the apex has to be behind every triangle plane along the axis
+    float maxt = 0;
+    for (size_t i=0; i<normals.size(); i++)
+        maxt = std::max(maxt, ((m.center-points[i])*normals[i])/(normals[i]*axis));
+    m.cone_apex = m.center - axis*maxt;
+    m.cone_axis = axis;
+    m.cone_cutoff = std::sqrt(1.f - mindp*mindp);
+}
+
+}
+
+std::vector<Meshlet> build_meshlets(const std::vector<Vec3f> &verts, std::vector<Vec3i> &faces, int max_faces, int max_verts) {
+    std::vector<Meshlet> res;
+    int nfaces = (int)faces.size()/3;
+    int nverts = (int)verts.size();
+
+    std::vector<Vec3f> fnormal(nfaces);
+    for (int f=0; f<nfaces; f++) {
+        Vec3f p0 = verts[faces[f*3][0]];
+        Vec3f n = cross(verts[faces[f*3+1][0]]-p0, verts[faces[f*3+2][0]]-p0);
+        float len = n.norm();
+        fnormal[f] = len>0 ? n/len : n;
+    }
+    std::vector<int> offset(nverts+1, 0);
+    for (int i=0; i<nfaces*3; i++) offset[faces[i][0]+1]++;
+    for (int v=0; v<nverts; v++) offset[v+1] += offset[v];
+    std::vector<int> adjacency(offset[nverts]), fill(offset.begin(), offset.end()-1);
+    for (int f=0; f<nfaces; f++)
+        for (int k=0; k<3; k++) adjacency[fill[faces[f*3+k][0]]++] = f;
+
+    auto face_center = [&](int f) {
+        return (verts[faces[f*3][0]] + verts[faces[f*3+1][0]] + verts[faces[f*3+2][0]])*(1.f/3);
+    };
+
+    // grow every cluster from the first free face in the current (cache friendly) order,
+    // always taking the free neighbour that adds the fewest vertices, the normal cone only breaks ties
+    std::vector<bool> taken(nfaces, false);
+    std::vector<int> order, used, members;
+    order.reserve(nfaces);
+    for (int seed=0; seed<nfaces; seed++) {
+        if (taken[seed]) continue;
+        Meshlet cur;
+        cur.first = (int)order.size();
+        cur.count = 0;
+        used.clear();
+        members.clear();
+        Vec3f axis, centroid;
+        int next = seed;
+        while (next>=0) {
+            taken[next] = true;
+            members.push_back(next);
+            for (int k=0; k<3; k++) {
+                int v = faces[next*3+k][0];
+                if (std::find(used.begin(), used.end(), v)==used.end()) used.push_back(v);
+            }
+            axis = axis + fnormal[next];
+            centroid = centroid + face_center(next);
+            Vec3f dir = axis.norm()>0 ? axis/axis.norm() : axis;
+            if ((int)members.size()==max_faces) break;
+
+            next = -1;
+            float best = -std::numeric_limits<float>::max();
+            for (size_t i=0; i<used.size(); i++) {
+                int v = used[i];
+                for (int j=offset[v]; j<offset[v+1]; j++) {
+                    int f = adjacency[j];
+                    if (taken[f]) continue;
+                    float dp = fnormal[f]*dir;
+                    int fresh = 0;
+                    for (int k=0; k<3; k++)
+                        fresh += std::find(used.begin(), used.end(), faces[f*3+k][0])==used.end();
+                    if ((int)used.size()+fresh>max_verts) continue;
+                    float score = dp - fresh;
+                    if (score>best) { best = score; next = f; }
+                }
+            }
+            if (next<0 && (int)used.size()+3<=max_verts) {
+                // no free neighbour fits (island or border): go on with the closest of the
+                // next few free faces of the incoming order rather than closing a small cluster
+                Vec3f center = centroid*(1.f/members.size());
+                float bestd = std::numeric_limits<float>::max();
+                for (int f=seed+1, seen=0; f<nfaces && seen<16; f++) {
+                    if (taken[f]) continue;
+                    seen++;
+                    float d = (face_center(f)-center).norm();
+                    if (d<bestd) { bestd = d; next = f; }
+                }
+            }
+        }
+        order.insert(order.end(), members.begin(), members.end());
+        cur.count = (int)members.size();
+        res.push_back(cur);
+    }
+
+    std::vector<Vec3i> sorted(faces.size());
+    for (int i=0; i<nfaces; i++)
+        for (int k=0; k<3; k++) sorted[i*3+k] = faces[order[i]*3+k];
+    faces.swap(sorted);
+    // clustering undid the incoming triangle order, optimize every cluster on its own
+    // (with local vertex ids, so the optimizer's tables stay max_verts long)
+    std::vector<Vec3i> local;
+    for (size_t i=0; i<res.size(); i++) {
+        used.clear();
+        local.assign(faces.begin()+res[i].first*3, faces.begin()+(res[i].first+res[i].count)*3);
+        for (size_t c=0; c<local.size(); c++) {
+            int v = local[c][0];
+            int id = (int)(std::find(used.begin(), used.end(), v)-used.begin());
+            if (id==(int)used.size()) used.push_back(v);
+            local[c][0] = id;
+        }
+        optimize_vertex_cache(local, (int)used.size());
+        for (size_t c=0; c<local.size(); c++) {
+            local[c][0] = used[local[c][0]];
+            faces[res[i].first*3+c] = local[c];
+        }
+        finish(res[i], verts, faces, used);
+    }
+    return res;
+}
+
+bool meshlet_visible(const Meshlet &m, Vec3f camera, Matrix M, int w, int h, bool backface) {
+    // backface cone test
+    Vec3f view = m.cone_apex - camera;
+    float dist = view.norm();
+    if (backface && dist>0 && (view*m.cone_axis)/dist>=m.cone_cutoff) return false;
+
+    // screen rectangle test on the box around the sphere
+    float lo[2] = { std::numeric_limits<float>::max(),  std::numeric_limits<float>::max()};
+    float hi[2] = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+    for (int i=0; i<8; i++) {
+        Vec3f c = m.center + Vec3f(i&1 ? m.radius : -m.radius, i&2 ? m.radius : -m.radius, i&4 ? m.radius : -m.radius);
+        Vec4f p = M*embed<4>(c);
+        if (p[3]<=0) return true; // crosses the eye plane, let the rasterizer deal with it
+        for (int j=0; j<2; j++) {
+            lo[j] = std::min(lo[j], p[j]/p[3]);
+            hi[j] = std::max(hi[j], p[j]/p[3]);
+        }
+    }
+    return !(hi[0]<0 || hi[1]<0 || lo[0]>w || lo[1]>h);
+}
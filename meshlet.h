@@ -0,0 +1,32 @@
+#ifndef __MESHLET_H__
+#define __MESHLET_H__
+
+#include <vector>
+#include "geometry.h"
+
+// A cluster of neighbouring triangles with the data needed to reject it as a
+// whole: a bounding sphere for the view test and a normal cone for the
+// backface test (same conventions as meshoptimizer's meshopt_Bounds).
+struct Meshlet {
+    int first;          // first face of the cluster in the index buffer
+    int count;          // number of faces
+    Vec3f center;       // bounding sphere
+    float radius;
+    Vec3f cone_apex;    // every triangle faces away from eyes inside the cone
+    Vec3f cone_axis;
+    float cone_cutoff;  // cos of the cone half angle, 1 when the cluster can not be backface culled
+};
+
+// Groups a Model style triangle index buffer into clusters of at most
+// max_faces triangles and max_verts distinct vertices, grown over shared
+// vertices (face normals only break ties, so wide clusters may get no cone).
+// Faces are reordered so that every cluster is a contiguous range, each
+// cluster is then optimized for the vertex cache on its own.
+std::vector<Meshlet> build_meshlets(const std::vector<Vec3f> &verts, std::vector<Vec3i> &faces, int max_faces=124, int max_verts=64);
+
+// camera is the eye position in the object space of the mesh, M maps object
+// space to the screen (viewport*projection*modelview); the cone test only runs
+// with backface set, open or two-sided meshes need their back faces drawn
+bool meshlet_visible(const Meshlet &m, Vec3f camera, Matrix M, int w, int h, bool backface);
+
+#endif //__MESHLET_H__
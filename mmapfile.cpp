@@ -0,0 +1,95 @@
+#include "mmapfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : base_(NULL), mapped_(0), data_(NULL), size_(0),
+#ifdef _WIN32
+    file_(NULL), mapping_(NULL)
+#else
+    fd_(-1)
+#endif
+{
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+long long MappedFile::file_size(const char *filename) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesExA(filename, GetFileExInfoStandard, &attr)) return -1;
+    return ((long long)attr.nFileSizeHigh<<32) | attr.nFileSizeLow;
+#else
+    struct stat st;
+    if (stat(filename, &st)) return -1;
+    return (long long)st.st_size;
+#endif
+}
+
+bool MappedFile::open(const char *filename) {
+    long long size = file_size(filename);
+    if (size<0) return false;
+    return open(filename, 0, (size_t)size);
+}
+
+bool MappedFile::open(const char *filename, size_t offset, size_t length) {
+    close();
+    long long fsize = file_size(filename);
+    if (fsize<0 || offset>(size_t)fsize || length>(size_t)fsize-offset) return false;
+    if (!length) return true; // nothing to map, data() stays NULL
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    size_t align = offset % info.dwAllocationGranularity;
+    file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file_==INVALID_HANDLE_VALUE) { file_ = NULL; return false; }
+    mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping_) { close(); return false; }
+    unsigned long long start = offset - align;
+    base_ = MapViewOfFile(mapping_, FILE_MAP_READ, (DWORD)(start>>32), (DWORD)(start & 0xffffffff), length+align);
+    if (!base_) { close(); return false; }
+#else
+    size_t align = offset % (size_t)sysconf(_SC_PAGESIZE);
+    fd_ = ::open(filename, O_RDONLY);
+    if (fd_<0) return false;
+    base_ = mmap(NULL, length+align, PROT_READ, MAP_SHARED, fd_, (off_t)(offset-align));
+    if (base_==MAP_FAILED) { base_ = NULL; close(); return false; }
+#endif
+    mapped_ = length+align;
+    data_ = (const unsigned char *)base_ + align;
+    size_ = length;
+    return true;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (base_) UnmapViewOfFile(base_);
+    if (mapping_) CloseHandle(mapping_);
+    if (file_) CloseHandle(file_);
+    mapping_ = file_ = NULL;
+#else
+    if (base_) munmap(base_, mapped_);
+    if (fd_>=0) ::close(fd_);
+    fd_ = -1;
+#endif
+    base_ = NULL;
+    mapped_ = 0;
+    data_ = NULL;
+    size_ = 0;
+}
+
+const unsigned char *MappedFile::data() {
+    return data_;
+}
+
+size_t MappedFile::size() {
+    return size_;
+}
@@ -0,0 +1,32 @@
+#ifndef __MMAPFILE_H__
+#define __MMAPFILE_H__
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file or of a byte range of it.
+class MappedFile {
+private:
+    void *base_;          // start of the mapping, aligned down to the allocation granularity
+    size_t mapped_;       // length of the mapping
+    const unsigned char *data_;
+    size_t size_;
+#ifdef _WIN32
+    void *file_;
+    void *mapping_;
+#else
+    int fd_;
+#endif
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+public:
+    MappedFile();
+    ~MappedFile();
+    bool open(const char *filename);                             // the whole file
+    bool open(const char *filename, size_t offset, size_t length); // a window into it
+    void close();
+    const unsigned char *data();
+    size_t size();
+    static long long file_size(const char *filename); // -1 if it can not be opened
+};
+
+#endif //__MMAPFILE_H__
@@ -1,12 +1,43 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 #include "model.h"
+#include "threadpool.h"
+#include "texturecache.h"
+#include "simplify.h"
+#include "vcache.h"
+#include "quantize.h"
 
-Model::Model(const char *filename) : verts_(), faces_(), norms_(), uv_(), diffusemap_(), normalmap_(), specularmap_() {
+// true if every edge (by position index) is used by exactly two triangles
+static bool is_closed(const std::vector<Vec3i> &faces) {
+    std::vector<std::pair<int,int> > edges;
+    edges.reserve(faces.size());
+    for (size_t f=0; f+2<faces.size(); f+=3)
+        for (int k=0; k<3; k++) {
+            int a = faces[f+k][0], b = faces[f+(k+1)%3][0];
+            edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+        }
+    if (edges.empty()) return false;
+    std::sort(edges.begin(), edges.end());
+    for (size_t i=0; i<edges.size(); ) {
+        size_t j = i;
+        while (j<edges.size() && edges[j]==edges[i]) j++;
+        if (j-i!=2) return false;
+        i = j;
+    }
+    return true;
+}
+
+Model::Model(const char *filename) : verts_(), faces_(), lods_(), corners_(NULL), nfaces_(0), lod_(0), bbox_min_(), bbox_max_(), bvh_(), meshlets_(), closed_(false), compressed_(false), nverts_(0), qverts_(), qnorms_(), quv_(), norms_(), uv_(), diffusemap_(), normalmap_(), specularmap_() {
+    for (int i=0; i<NMAPS; i++) texture_ready_[i] = false;
+    TextureCache::instance(); // construct it before us, so it is destroyed after us (globals holding models must let go first, see ~Widget)
+    load_texture_async(filename, "_diffuse.tga", diffusemap_,  DIFFUSE);
+    load_texture_async(filename, "_nm.tga",      normalmap_,   NORMALMAP);
+    load_texture_async(filename, "_spec.tga",    specularmap_, SPECULAR);
     std::ifstream in;
     in.open (filename, std::ifstream::in);
-    if (in.fail()) return;
+    if (in.fail()) return; // the texture tasks are still joined by the destructor
     std::string line;
     while (!in.eof()) {
         std::getline(in, line);
@@ -35,57 +66,393 @@ Model::Model(const char *filename) : verts_(), faces_(), norms_(), uv_(), diffus
                 for (int i=0; i<3; i++) tmp[i]--; // in wavefront obj all indices start at 1, not zero
                 f.push_back(tmp);
             }
-            faces_.push_back(f);
+            if (f.size()>=3) triangulate(f);
         }
     }
-    std::cerr << "# v# " << verts_.size() << " f# "  << faces_.size() << " vt# " << uv_.size() << " vn# " << norms_.size() << std::endl;
-    load_texture(filename, "_diffuse.tga", diffusemap_);
-    load_texture(filename, "_nm.tga",      normalmap_);
-    load_texture(filename, "_spec.tga",    specularmap_);
+    set_lod(0);
+    std::cerr << "# v# " << verts_.size() << " f# "  << nfaces() << " vt# " << uv_.size() << " vn# " << norms_.size() << std::endl;
+    optimize_layout();
+    closed_ = is_closed(faces_);
+    bvh_.build(verts_, faces_);
+    build_lods();
 }
 
-Model::~Model() {}
+Model::Model() : verts_(), faces_(), lods_(), corners_(NULL), nfaces_(0), lod_(0), bbox_min_(), bbox_max_(), bvh_(), meshlets_(), closed_(false), compressed_(false), nverts_(0), qverts_(), qnorms_(), quv_(), norms_(), uv_(), diffusemap_(), normalmap_(), specularmap_() {
+    for (int i=0; i<NMAPS; i++) texture_ready_[i] = false;
+    TextureCache::instance();
+}
+
+void Model::set_triangles(std::vector<Vec3f> &verts, std::vector<Vec2f> &uv, std::vector<Vec3f> &norms) {
+    verts_.swap(verts);
+    uv_.swap(uv);
+    norms_.swap(norms);
+    faces_.resize(verts_.size());
+    for (int i=0; i<(int)faces_.size(); i++) faces_[i] = Vec3i(i, i, i);
+    lods_.clear();
+    meshlets_.clear();
+    closed_ = false;
+    compressed_ = false;
+    set_lod(0);
+}
+
+Model::~Model() {
+    wait_textures(); // the loading tasks write into this object
+    diffusemap_.reset();
+    normalmap_.reset();
+    specularmap_.reset();
+    TextureCache::instance().trim(); // our maps may have become evictable
+}
 
 int Model::nverts() {
-    return (int)verts_.size();
+    return compressed_ ? nverts_ : (int)verts_.size();
+}
+
+bool Model::compressed() {
+    return compressed_;
+}
+
+size_t Model::attribute_bytes() {
+    if (compressed_)
+        return qverts_.size()*sizeof(unsigned short) + qnorms_.size()*sizeof(short) + quv_.size()*sizeof(unsigned short);
+    return verts_.size()*sizeof(Vec3f) + norms_.size()*sizeof(Vec3f) + uv_.size()*sizeof(Vec2f);
+}
+
+size_t Model::geometry_bytes() {
+    size_t bytes = attribute_bytes() + faces_.size()*sizeof(Vec3i) + bvh_.bytes();
+    for (size_t i=0; i<lods_.size(); i++) bytes += lods_[i].size()*sizeof(Vec3i);
+    for (size_t i=0; i<meshlets_.size(); i++) bytes += meshlets_[i].size()*sizeof(Meshlet);
+    return bytes;
+}
+
+void Model::compress() {
+    if (compressed_) return;
+    size_t before = attribute_bytes();
+    size_t total_before = geometry_bytes();
+    Vec3f extent = bbox_max_ - bbox_min_;
+    nverts_ = (int)verts_.size();
+    qverts_.resize(verts_.size()*3);
+    for (size_t i=0; i<verts_.size(); i++)
+        for (int j=0; j<3; j++) qverts_[i*3+j] = quantize_unorm16(verts_[i][j], bbox_min_[j], extent[j]);
+    qnorms_.resize(norms_.size()*2);
+    for (size_t i=0; i<norms_.size(); i++) encode_octahedral(norms_[i], &qnorms_[i*2]);
+    quv_.resize(uv_.size()*2);
+    for (size_t i=0; i<uv_.size(); i++)
+        for (int j=0; j<2; j++) quv_[i*2+j] = float_to_half(uv_[i][j]);
+    std::vector<Vec3f>().swap(verts_);
+    std::vector<Vec3f>().swap(norms_);
+    std::vector<Vec2f>().swap(uv_);
+    compressed_ = true;
+    // ray tests decode the corners they visit, the float copy was larger than the quantized attributes
+    bvh_.drop_triangles([this](int iface, Vec3f tri[3]) {
+        for (int k=0; k<3; k++) tri[k] = position(faces_[iface*3+k][0]);
+    });
+    std::cerr << "# compressed attributes " << before << " -> " << attribute_bytes() << " bytes, geometry "
+              << total_before << " -> " << geometry_bytes() << " bytes" << std::endl;
+}
+
+Vec3f Model::position(int i) {
+    if (!compressed_) return verts_[i];
+    Vec3f extent = bbox_max_ - bbox_min_;
+    const unsigned short *q = &qverts_[i*3];
+    return Vec3f(dequantize_unorm16(q[0], bbox_min_.x, extent.x),
+                 dequantize_unorm16(q[1], bbox_min_.y, extent.y),
+                 dequantize_unorm16(q[2], bbox_min_.z, extent.z));
+}
+
+Vec2f Model::texcoord(int i) {
+    if (!compressed_) return uv_[i];
+    return Vec2f(half_to_float(quv_[i*2]), half_to_float(quv_[i*2+1]));
+}
+
+Vec3f Model::vnormal(int i) {
+    if (!compressed_) return norms_[i];
+    return decode_octahedral(&qnorms_[i*2]);
 }
 
 int Model::nfaces() {
-    return (int)faces_.size();
+    return nfaces_;
+}
+
+int Model::nlods() {
+    return 1 + (int)lods_.size();
+}
+
+int Model::lod() {
+    return lod_;
+}
+
+void Model::set_lod(int level) {
+    lod_ = std::max(0, std::min(level, nlods()-1));
+    const std::vector<Vec3i> &buf = lod_ ? lods_[lod_-1] : faces_;
+    corners_ = buf.data();
+    nfaces_ = (int)buf.size()/3;
+}
+
+int Model::lod_for_screen_size(float pixels) {
+    // about one triangle per 8 square pixels of the bounding square, half of them face away
+    float wanted = pixels*pixels/8.f;
+    int level = 0;
+    for (int i=1; i<nlods(); i++)
+        if (lods_[i-1].size()/3>=wanted) level = i;
+    return level;
+}
+
+Vec3f Model::bbox_min() {
+    return bbox_min_;
+}
+
+Vec3f Model::bbox_max() {
+    return bbox_max_;
+}
+
+// Reorders the triangles for post-transform vertex cache reuse, groups them into
+// clusters (each optimized again on its own), then renumbers positions, uvs and
+// normals in first-use order so the attribute fetches of consecutive triangles
+// stay close in memory.
+void Model::optimize_layout() {
+    const int nverts = (int)verts_.size();
+    for (size_t i=0; i<faces_.size(); i++) {
+        if (faces_[i][0]<0 || faces_[i][0]>=nverts) return; // broken indices, leave the file order alone
+    }
+    VertexCacheStats before = analyze_vertex_cache(faces_, nverts);
+    optimize_vertex_cache(faces_, nverts); // seeds the clusters in a cache friendly order
+    meshlets_.push_back(build_meshlets(verts_, faces_)); // reorders faces_, so before anything indexes them
+
+    int sizes[3] = {nverts, (int)uv_.size(), (int)norms_.size()};
+    std::vector<int> remap[3];
+    for (int a=0; a<3; a++) {
+        remap[a].assign(sizes[a], -1);
+        int next = 0;
+        for (size_t i=0; i<faces_.size(); i++) {
+            int idx = faces_[i][a];
+            if (idx<0 || idx>=sizes[a]) continue;
+            if (remap[a][idx]<0) remap[a][idx] = next++;
+        }
+        for (int i=0; i<sizes[a]; i++) if (remap[a][i]<0) remap[a][i] = next++; // unreferenced ones go last
+        for (size_t i=0; i<faces_.size(); i++) {
+            int idx = faces_[i][a];
+            if (idx>=0 && idx<sizes[a]) faces_[i][a] = remap[a][idx];
+        }
+    }
+    std::vector<Vec3f> verts(nverts), norms(norms_.size());
+    std::vector<Vec2f> uv(uv_.size());
+    for (int i=0; i<sizes[0]; i++) verts[remap[0][i]] = verts_[i];
+    for (int i=0; i<sizes[1]; i++) uv[remap[1][i]] = uv_[i];
+    for (int i=0; i<sizes[2]; i++) norms[remap[2][i]] = norms_[i];
+    verts_.swap(verts);
+    uv_.swap(uv);
+    norms_.swap(norms);
+    set_lod(0);
+
+    VertexCacheStats after = analyze_vertex_cache(faces_, nverts);
+    std::cerr << "# acmr " << before.acmr << " -> " << after.acmr << " atvr " << before.atvr << " -> " << after.atvr << std::endl;
+}
+
+int Model::pick(Vec3f orig, Vec3f dir, Vec2f &uv, float &t) {
+    Vec3f bar;
+    int iface = bvh_.intersect(orig, dir, t, bar);
+    if (iface<0) return -1;
+    uv = Vec2f(0, 0);
+    for (int k=0; k<3; k++) {
+        int idx = faces_[iface*3+k][1];
+        if (idx>=0 && idx<(int)(compressed_ ? quv_.size()/2 : uv_.size())) uv = uv + texcoord(idx)*bar[k];
+    }
+    return iface;
+}
+
+bool Model::closed() {
+    return closed_;
+}
+
+int Model::nmeshlets() {
+    return lod_<(int)meshlets_.size() ? (int)meshlets_[lod_].size() : 0;
+}
+
+void Model::cull_meshlets(Vec3f camera, Matrix M, int w, int h, std::vector<int> &faces, bool backface) {
+    faces.clear();
+    if (lod_>=(int)meshlets_.size()) return;
+    const std::vector<Meshlet> &clusters = meshlets_[lod_];
+    for (size_t i=0; i<clusters.size(); i++) {
+        const Meshlet &m = clusters[i];
+        if (!meshlet_visible(m, camera, M, w, h, backface)) continue;
+        for (int f=m.first; f<m.first+m.count; f++) faces.push_back(f);
+    }
+}
+
+// Every level halves the triangle count of the previous one, until the mesh
+// gets small or the simplifier can not make progress (locked seams/borders).
+void Model::build_lods() {
+    if (!verts_.empty()) bbox_min_ = bbox_max_ = verts_[0];
+    for (size_t i=0; i<verts_.size(); i++)
+        for (int j=0; j<3; j++) {
+            bbox_min_[j] = std::min(bbox_min_[j], verts_[i][j]);
+            bbox_max_[j] = std::max(bbox_max_[j], verts_[i][j]);
+        }
+    if (meshlets_.empty()) return; // broken indices, see optimize_layout(); level i+1 must pair with meshlets_[i+1]
+    const int min_faces = 256;
+    const int nverts = (int)verts_.size();
+    const std::vector<Vec3i> *prev = &faces_;
+    while ((int)prev->size()/3>=min_faces*2) {
+        int nprev = (int)prev->size()/3;
+        std::vector<Vec3i> level = simplify(verts_, *prev, nprev/2);
+        if ((int)level.size()/3>nprev*9/10) break;
+        optimize_vertex_cache(level, nverts);
+        meshlets_.push_back(build_meshlets(verts_, level));
+        lods_.push_back(level);
+        prev = &lods_.back();
+        std::cerr << "# lod " << lods_.size() << " f# " << level.size()/3 << " acmr " << analyze_vertex_cache(level, nverts).acmr << std::endl;
+    }
+    std::cerr << "# meshlets " << meshlets_[0].size() << std::endl;
+    set_lod(0);
 }
 
 std::vector<int> Model::face(int idx) {
     std::vector<int> face;
-    for (int i=0; i<(int)faces_[idx].size(); i++) face.push_back(faces_[idx][i][0]);
+    for (int i=0; i<3; i++) face.push_back(corners_[idx*3+i][0]);
     return face;
 }
 
 Vec3f Model::vert(int i) {
-    return verts_[i];
+    return position(i);
 }
 
 Vec3f Model::vert(int iface, int nthvert) {
-    return verts_[faces_[iface][nthvert][0]];
+    return position(corners_[iface*3+nthvert][0]);
+}
+
+// Split an n-gon into triangles appended to faces_. Convex polygons are fanned
+// from the first corner; concave ones go through ear clipping in the plane of
+// the polygon (dropping the dominant axis of its Newell normal).
+void Model::triangulate(const std::vector<Vec3i> &poly) {
+    int n = (int)poly.size();
+    if (3==n) {
+        for (int i=0; i<3; i++) faces_.push_back(poly[i]);
+        return;
+    }
+    std::vector<Vec2f> p(n);
+    bool valid = true;
+    Vec3f normal;
+    for (int i=0; i<n; i++) {
+        int a = poly[i][0], b = poly[(i+1)%n][0];
+        if (a<0 || b<0 || a>=(int)verts_.size() || b>=(int)verts_.size()) { valid = false; break; }
+        Vec3f va = verts_[a], vb = verts_[b];
+        normal.x += (va.y-vb.y)*(va.z+vb.z);
+        normal.y += (va.z-vb.z)*(va.x+vb.x);
+        normal.z += (va.x-vb.x)*(va.y+vb.y);
+    }
+    if (valid) {
+        int axis = 2;
+        if (std::abs(normal.x)>=std::abs(normal.y) && std::abs(normal.x)>=std::abs(normal.z)) axis = 0;
+        else if (std::abs(normal.y)>=std::abs(normal.z)) axis = 1;
+        float sign = normal[axis]<0 ? -1.f : 1.f; // keep the projected polygon counter-clockwise
+        for (int i=0; i<n; i++) {
+            Vec3f v = verts_[poly[i][0]];
+            p[i] = Vec2f(v[(axis+1)%3], v[(axis+2)%3]*sign);
+        }
+    }
+    auto turn = [&p](int a, int b, int c) {
+        return (p[b].x-p[a].x)*(p[c].y-p[a].y) - (p[b].y-p[a].y)*(p[c].x-p[a].x);
+    };
+    bool convex = true;
+    for (int i=0; valid && convex && i<n; i++)
+        convex = turn(i, (i+1)%n, (i+2)%n)>=0;
+    if (!valid || convex) {
+        for (int i=1; i+1<n; i++) {
+            faces_.push_back(poly[0]);
+            faces_.push_back(poly[i]);
+            faces_.push_back(poly[i+1]);
+        }
+        return;
+    }
+
+    std::vector<int> idx(n);
+    for (int i=0; i<n; i++) idx[i] = i;
+    while (idx.size()>3) {
+        int m = (int)idx.size();
+        bool clipped = false;
+        for (int i=0; i<m && !clipped; i++) {
+            int a = idx[(i+m-1)%m], b = idx[i], c = idx[(i+1)%m];
+            if (turn(a, b, c)<=0) continue; // reflex corner
+            bool ear = true;
+            for (int j=0; j<m && ear; j++) {
+                int q = idx[j];
+                if (q==a || q==b || q==c) continue;
+                ear = !(turn(a, b, q)>=0 && turn(b, c, q)>=0 && turn(c, a, q)>=0);
+            }
+            if (!ear) continue;
+            faces_.push_back(poly[a]);
+            faces_.push_back(poly[b]);
+            faces_.push_back(poly[c]);
+            idx.erase(idx.begin()+i);
+            clipped = true;
+        }
+        if (!clipped) break; // self-intersecting polygon without ears, fan whatever is left
+    }
+    for (int i=1; i+1<(int)idx.size(); i++) {
+        faces_.push_back(poly[idx[0]]);
+        faces_.push_back(poly[idx[i]]);
+        faces_.push_back(poly[idx[i+1]]);
+    }
 }
 
-void Model::load_texture(std::string filename, const char *suffix, TGAImage &img) {
+void Model::load_texture(std::string filename, const char *suffix, std::shared_ptr<TGAImage> &img) {
     std::string texfile(filename);
     size_t dot = texfile.find_last_of(".");
     if (dot!=std::string::npos) {
         texfile = texfile.substr(0,dot) + std::string(suffix);
-        std::cerr << "texture file " << texfile << " loading " << (img.read_tga_file(texfile.c_str()) ? "ok" : "failed") << std::endl;
-        img.flip_vertically();
+        img = TextureCache::instance().acquire(texfile);
+        std::cerr << "texture file " << texfile << " loading " << (img ? "ok" : "failed") << std::endl;
     }
+    if (!img) img = std::make_shared<TGAImage>(); // samplers never see a null map
+}
+
+void Model::load_texture_async(std::string filename, const char *suffix, std::shared_ptr<TGAImage> &img, TextureMap map) {
+    texture_futures_[map] = ThreadPool::instance().submit([this, filename, suffix, &img, map]() {
+        load_texture(filename, suffix, img);
+        texture_ready_[map].store(true, std::memory_order_release);
+        return img->get_width()>0;
+    }).share();
+}
+
+bool Model::texture_ready(TextureMap map) {
+    return texture_ready_[map].load(std::memory_order_acquire);
+}
+
+bool Model::textures_ready() {
+    for (int i=0; i<NMAPS; i++)
+        if (!texture_ready((TextureMap)i)) return false;
+    return true;
+}
+
+std::shared_future<bool> Model::texture_future(TextureMap map) {
+    return texture_futures_[map];
+}
+
+void Model::wait_textures() {
+    for (int i=0; i<NMAPS; i++)
+        if (texture_futures_[i].valid()) texture_futures_[i].wait();
+}
+
+void Model::touch_textures() {
+    if (texture_ready(DIFFUSE))   TextureCache::instance().touch(diffusemap_.get());
+    if (texture_ready(NORMALMAP)) TextureCache::instance().touch(normalmap_.get());
+    if (texture_ready(SPECULAR))  TextureCache::instance().touch(specularmap_.get());
+}
+
+const TGAImage *Model::diffuse_map() {
+    return texture_ready(DIFFUSE) ? diffusemap_.get() : nullptr;
 }
 
 TGAColor Model::diffuse(Vec2f uvf) {
-    Vec2i uv(uvf[0]*diffusemap_.get_width(), uvf[1]*diffusemap_.get_height());
-    return diffusemap_.get(uv[0], uv[1]);
+    if (!texture_ready(DIFFUSE)) return TGAColor(255, 255, 255);
+    Vec2i uv(uvf[0]*diffusemap_->get_width(), uvf[1]*diffusemap_->get_height());
+    return diffusemap_->get(uv[0], uv[1]);
 }
 
 Vec3f Model::normal(Vec2f uvf) {
-    Vec2i uv(uvf[0]*normalmap_.get_width(), uvf[1]*normalmap_.get_height());
-    TGAColor c = normalmap_.get(uv[0], uv[1]);
+    if (!texture_ready(NORMALMAP)) return Vec3f(0, 0, 1);
+    Vec2i uv(uvf[0]*normalmap_->get_width(), uvf[1]*normalmap_->get_height());
+    TGAColor c = normalmap_->get(uv[0], uv[1]);
     Vec3f res;
     for (int i=0; i<3; i++)
         res[2-i] = (float)c[i]/255.f*2.f - 1.f;
@@ -93,15 +460,16 @@ Vec3f Model::normal(Vec2f uvf) {
 }
 
 Vec2f Model::uv(int iface, int nthvert) {
-    return uv_[faces_[iface][nthvert][1]];
+    return texcoord(corners_[iface*3+nthvert][1]);
 }
 
 float Model::specular(Vec2f uvf) {
-    Vec2i uv(uvf[0]*specularmap_.get_width(), uvf[1]*specularmap_.get_height());
-    return specularmap_.get(uv[0], uv[1])[0]/1.f;
+    if (!texture_ready(SPECULAR)) return 255.f; // tight highlight until the map is in
+    Vec2i uv(uvf[0]*specularmap_->get_width(), uvf[1]*specularmap_->get_height());
+    return specularmap_->get(uv[0], uv[1])[0]/1.f;
 }
 
 Vec3f Model::normal(int iface, int nthvert) {
-    int idx = faces_[iface][nthvert][2];
-    return norms_[idx].normalize();
+    int idx = corners_[iface*3+nthvert][2];
+    return vnormal(idx).normalize();
 }
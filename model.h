@@ -2,24 +2,81 @@
 #define __MODEL_H__
 #include <vector>
 #include <string>
+#include <atomic>
+#include <future>
+#include <memory>
 #include "geometry.h"
 #include "tgaimage.h"
+#include "bvh.h"
+#include "meshlet.h"
 
 class Model {
+public:
+    enum TextureMap {
+        DIFFUSE=0, NORMALMAP=1, SPECULAR=2, NMAPS=3
+    };
 private:
     std::vector<Vec3f> verts_;
-    std::vector<std::vector<Vec3i> > faces_; // attention, this Vec3i means vertex/uv/normal
+    std::vector<Vec3i> faces_; // triangle index buffer, 3 corners per face; attention, this Vec3i means vertex/uv/normal
+    std::vector<std::vector<Vec3i> > lods_; // simplified copies of faces_, lods_[i] is level i+1
+    const Vec3i *corners_; // index buffer of the current level
+    int nfaces_;
+    int lod_;
+    Vec3f bbox_min_, bbox_max_;
+    BVH bvh_; // over the full resolution faces
+    std::vector<std::vector<Meshlet> > meshlets_; // clusters of every level of detail
+    bool closed_; // no border edges, see closed()
+    // compact attributes, replace verts_/norms_/uv_ after compress()
+    bool compressed_;
+    int nverts_;
+    std::vector<unsigned short> qverts_; // 3 per vertex, quantized to the bounding box
+    std::vector<short> qnorms_;          // 2 per normal, octahedral snorm16
+    std::vector<unsigned short> quv_;    // 2 per uv, half floats
+    Vec3f position(int i);
+    Vec2f texcoord(int i);
+    Vec3f vnormal(int i);
     std::vector<Vec3f> norms_;
     std::vector<Vec2f> uv_;
-    TGAImage diffusemap_;
-    TGAImage normalmap_;
-    TGAImage specularmap_;
-    void load_texture(std::string filename, const char *suffix, TGAImage &img);
+    std::shared_ptr<TGAImage> diffusemap_;  // shared through TextureCache
+    std::shared_ptr<TGAImage> normalmap_;
+    std::shared_ptr<TGAImage> specularmap_;
+    // maps are decoded on the thread pool while the geometry is parsed,
+    // samplers fall back to neutral values until the matching flag is raised
+    std::shared_future<bool> texture_futures_[NMAPS];
+    std::atomic<bool> texture_ready_[NMAPS];
+    void load_texture(std::string filename, const char *suffix, std::shared_ptr<TGAImage> &img);
+    void load_texture_async(std::string filename, const char *suffix, std::shared_ptr<TGAImage> &img, TextureMap map);
+    void triangulate(const std::vector<Vec3i> &poly);
+    void build_lods();
+    void optimize_layout();
 public:
     Model(const char *filename);
+    Model(); // no geometry nor textures, see set_triangles()
+    // de-indexed triangle soup, 3 entries per triangle in every array; takes the contents
+    void set_triangles(std::vector<Vec3f> &verts, std::vector<Vec2f> &uv, std::vector<Vec3f> &norms);
     ~Model();
     int nverts();
-    int nfaces();
+    int nfaces(); // of the current level of detail
+    // switch to 16 bit positions, octahedral normals and half float uvs (~2.3x smaller
+    // attributes) and drop the BVH's float triangles; every level, BVH and cluster
+    // must be built before, they read the float arrays
+    void compress();
+    bool compressed();
+    size_t attribute_bytes();
+    size_t geometry_bytes(); // attributes, index buffers of every level, BVH and clusters
+    int nlods();
+    int lod();
+    void set_lod(int level);
+    int lod_for_screen_size(float pixels); // coarsest level still dense enough for that many pixels across
+    Vec3f bbox_min();
+    Vec3f bbox_max();
+    // closest full resolution face hit by the object space ray, -1 if none; fills the uv of the hit
+    int pick(Vec3f orig, Vec3f dir, Vec2f &uv, float &t);
+    int nmeshlets(); // of the current level of detail
+    // faces of the current level whose cluster survives the screen test, and the cone
+    // test if backface is set; camera is the eye in object space, M is viewport*projection*modelview
+    void cull_meshlets(Vec3f camera, Matrix M, int w, int h, std::vector<int> &faces, bool backface);
+    bool closed(); // every edge shared by two faces: back faces can not be seen from outside
     Vec3f normal(int iface, int nthvert);
     Vec3f normal(Vec2f uv);
     Vec3f vert(int i);
@@ -28,5 +85,11 @@ public:
     TGAColor diffuse(Vec2f uv);
     float specular(Vec2f uv);
     std::vector<int> face(int idx);
+    bool texture_ready(TextureMap map);
+    bool textures_ready();
+    std::shared_future<bool> texture_future(TextureMap map);
+    void wait_textures();
+    void touch_textures(); // tell the texture cache these maps were sampled this frame
+    const TGAImage *diffuse_map(); // nullptr while loading, used as a sort key
 };
 #endif //__MODEL_H__
\ No newline at end of file
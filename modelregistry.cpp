@@ -0,0 +1,143 @@
+#include <iostream>
+#include "modelregistry.h"
+#include "threadpool.h"
+
+ModelRegistry::ModelRegistry() : slots_(), mutex_(), clock_(0), compress_(false) {
+}
+
+int ModelRegistry::add(const std::string &filename) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Slot s;
+    s.filename = filename;
+    s.last_used = 0;
+    slots_.push_back(s);
+    return (int)slots_.size()-1;
+}
+
+int ModelRegistry::size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return (int)slots_.size();
+}
+
+void ModelRegistry::set_compress(bool on) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    compress_ = on;
+}
+
+static bool is_ready(const std::shared_future<std::shared_ptr<Model> > &f) {
+    return f.valid() && f.wait_for(std::chrono::seconds(0))==std::future_status::ready;
+}
+
+std::shared_future<std::shared_ptr<Model> > ModelRegistry::request(int id, Callback on_ready) {
+    std::shared_future<std::shared_ptr<Model> > f;
+    std::shared_ptr<Waiting> waiting;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (id<0 || id>=(int)slots_.size()) return f;
+        Slot &s = slots_[id];
+        s.last_used = ++clock_;
+        if (!s.model.valid()) {
+            std::string filename = s.filename;
+            bool compress = compress_;
+            //the future is set before the callbacks run, so they see loaded(id)==true
+            std::shared_ptr<std::promise<std::shared_ptr<Model> > > done = std::make_shared<std::promise<std::shared_ptr<Model> > >();
+            s.model = done->get_future().share();
+            s.waiting = std::make_shared<Waiting>();
+            s.waiting->done = false;
+            if (on_ready) s.waiting->callbacks.push_back(on_ready);
+            waiting = s.waiting;
+            ThreadPool::instance().submit([filename, compress, waiting, done]() mutable {
+                std::shared_ptr<Model> m;
+                try {
+                    m = std::make_shared<Model>(filename.c_str());
+                    if (compress) m->compress();
+                } catch (...) { // nothing would catch it on the pool
+                    std::cerr << "can't load " << filename << std::endl;
+                    m.reset();
+                }
+                done->set_value(m);
+                done.reset(); // the registry's future is now the only owner besides us
+                std::vector<Callback> callbacks;
+                {
+                    std::lock_guard<std::mutex> lock(waiting->mutex);
+                    waiting->done = true;
+                    callbacks.swap(waiting->callbacks);
+                }
+                for (size_t i=0; i<callbacks.size(); i++) callbacks[i](m);
+            });
+            return s.model;
+        }
+        f = s.model;
+        waiting = s.waiting;
+    }
+    if (on_ready) {
+        if (waiting) { // someone else started the load, its task runs us when it is done
+            std::lock_guard<std::mutex> lock(waiting->mutex);
+            if (!waiting->done) {
+                waiting->callbacks.push_back(on_ready);
+                return f;
+            }
+        }
+        on_ready(f.get());
+    }
+    return f;
+}
+
+std::shared_ptr<Model> ModelRegistry::get(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (id<0 || id>=(int)slots_.size() || !is_ready(slots_[id].model)) return std::shared_ptr<Model>();
+    slots_[id].last_used = ++clock_;
+    return slots_[id].model.get();
+}
+
+bool ModelRegistry::loaded(int id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return id>=0 && id<(int)slots_.size() && is_ready(slots_[id].model);
+}
+
+void ModelRegistry::unload(int id) {
+    std::shared_future<std::shared_ptr<Model> > victim;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (id<0 || id>=(int)slots_.size()) return;
+        victim = slots_[id].model;
+        slots_[id].model = std::shared_future<std::shared_ptr<Model> >();
+        slots_[id].waiting.reset();
+    }
+    // the model itself goes away with the last reference, outside of our lock
+}
+
+void ModelRegistry::clear() {
+    std::vector<std::shared_future<std::shared_ptr<Model> > > victims;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i=0; i<slots_.size(); i++) {
+            if (slots_[i].model.valid()) victims.push_back(slots_[i].model);
+            slots_[i].model = std::shared_future<std::shared_ptr<Model> >();
+            slots_[i].waiting.reset();
+        }
+    }
+    for (size_t i=0; i<victims.size(); i++) victims[i].wait(); // a load in flight must not outlive us
+}
+
+void ModelRegistry::trim(int max_resident) {
+    std::vector<std::shared_future<std::shared_ptr<Model> > > victims;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int resident = 0;
+        for (size_t i=0; i<slots_.size(); i++) resident += slots_[i].model.valid();
+        while (resident>max_resident) {
+            int lru = -1;
+            for (int i=0; i<(int)slots_.size(); i++) {
+                if (!is_ready(slots_[i].model)) continue;
+                if (slots_[i].model.get().use_count()>1) continue; // still in use
+                if (lru<0 || slots_[i].last_used<slots_[lru].last_used) lru = i;
+            }
+            if (lru<0) break;
+            victims.push_back(slots_[lru].model);
+            slots_[lru].model = std::shared_future<std::shared_ptr<Model> >();
+            slots_[lru].waiting.reset();
+            resident--;
+        }
+    }
+}
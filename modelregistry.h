@@ -0,0 +1,51 @@
+#ifndef __MODELREGISTRY_H__
+#define __MODELREGISTRY_H__
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <future>
+#include <functional>
+#include "model.h"
+
+// Catalogue of the models the application can show. Nothing is parsed until a
+// model is first requested; loading happens on the thread pool and models
+// that are no longer referenced can be dropped again to bound memory use.
+class ModelRegistry {
+public:
+    typedef std::function<void(std::shared_ptr<Model>)> Callback;
+private:
+    // callbacks of the requests made while a model loads, run by the loading task
+    struct Waiting {
+        std::mutex mutex;
+        std::vector<Callback> callbacks;
+        bool done;
+    };
+    struct Slot {
+        std::string filename;
+        std::shared_future<std::shared_ptr<Model> > model; // invalid while not resident
+        std::shared_ptr<Waiting> waiting; // of the load that filled model
+        unsigned long last_used;
+    };
+    std::vector<Slot> slots_;
+    std::mutex mutex_;
+    unsigned long clock_;
+    bool compress_;
+public:
+    ModelRegistry();
+    int add(const std::string &filename);
+    int size();
+    void set_compress(bool on); // store models loaded from now on with Model::compress()
+    // starts a background load if needed; on_ready runs on the loading thread
+    // (or immediately on the caller's thread if the model is already resident),
+    // with nullptr if the load failed
+    std::shared_future<std::shared_ptr<Model> > request(int id, Callback on_ready=Callback());
+    std::shared_ptr<Model> get(int id); // nullptr until the model is loaded, never blocks
+    bool loaded(int id);
+    void unload(int id);
+    void trim(int max_resident); // unload least recently used models nobody else holds
+    void clear(); // unload everything, waiting for loads in flight
+};
+
+#endif //__MODELREGISTRY_H__
@@ -0,0 +1,97 @@
+#ifndef __QUANTIZE_H__
+#define __QUANTIZE_H__
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "geometry.h"
+
+// Compact encodings for vertex attributes, see Model::compress().
+
+// value in [lo, lo+extent] <-> 16 bit unsigned
+inline unsigned short quantize_unorm16(float v, float lo, float extent) {
+    if (extent<=0) return 0;
+    float t = std::max(0.f, std::min(1.f, (v-lo)/extent));
+    return (unsigned short)(t*65535.f + .5f);
+}
+
+inline float dequantize_unorm16(unsigned short q, float lo, float extent) {
+    return lo + q*(extent/65535.f);
+}
+
+// unit vector <-> two 16 bit snorm components of its octahedral projection
+inline void encode_octahedral(Vec3f n, short out[2]) {
+    float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1<=0) { out[0] = out[1] = 0; return; }
+    float x = n.x/l1, y = n.y/l1;
+    if (n.z<0) { // fold the lower hemisphere over the diagonals
+        float fx = (1.f-std::abs(y))*(x>=0 ? 1.f : -1.f);
+        float fy = (1.f-std::abs(x))*(y>=0 ? 1.f : -1.f);
+        x = fx;
+        y = fy;
+    }
+    out[0] = (short)std::lround(std::max(-1.f, std::min(1.f, x))*32767.f);
+    out[1] = (short)std::lround(std::max(-1.f, std::min(1.f, y))*32767.f);
+}
+
+inline Vec3f decode_octahedral(const short in[2]) {
+    Vec3f n(in[0]/32767.f, in[1]/32767.f, 0.f);
+    n.z = 1.f - std::abs(n.x) - std::abs(n.y);
+    if (n.z<0) {
+        float x = (1.f-std::abs(n.y))*(n.x>=0 ? 1.f : -1.f);
+        float y = (1.f-std::abs(n.x))*(n.y>=0 ? 1.f : -1.f);
+        n.x = x;
+        n.y = y;
+    }
+    return n.normalize();
+}
+
+// IEEE 754 binary16, round to nearest even, no NaN payloads
+inline unsigned short float_to_half(float f) {
+    unsigned int x;
+    memcpy(&x, &f, 4);
+    unsigned int sign = (x>>16) & 0x8000;
+    int exp = (int)((x>>23) & 0xff) - 127 + 15;
+    unsigned int mant = x & 0x7fffff;
+    if (((x>>23) & 0xff)==0xff) return (unsigned short)(sign | 0x7c00 | (mant ? 0x200 : 0)); // inf/nan
+    if (exp>=31) return (unsigned short)(sign | 0x7c00); // overflow
+    if (exp<=0) { // subnormal half or zero
+        if (exp<-10) return (unsigned short)sign;
+        mant |= 0x800000;
+        int shift = 14 - exp;
+        unsigned int half = mant>>shift;
+        unsigned int rest = mant & ((1u<<shift)-1);
+        unsigned int mid = 1u<<(shift-1);
+        if (rest>mid || (rest==mid && (half & 1))) half++;
+        return (unsigned short)(sign | half);
+    }
+    unsigned int half = sign | (exp<<10) | (mant>>13);
+    unsigned int rest = mant & 0x1fff;
+    if (rest>0x1000 || (rest==0x1000 && (half & 1))) half++; // may carry into the exponent, which is right
+    return (unsigned short)half;
+}
+
+inline float half_to_float(unsigned short h) {
+    unsigned int sign = (unsigned int)(h & 0x8000)<<16;
+    unsigned int exp = (h>>10) & 0x1f;
+    unsigned int mant = h & 0x3ff;
+    unsigned int x;
+    if (exp==0) {
+        if (!mant) {
+            x = sign;
+        } else { // subnormal, renormalize
+            exp = 127 - 15 + 1;
+            while (!(mant & 0x400)) { mant <<= 1; exp--; }
+            x = sign | (exp<<23) | ((mant & 0x3ff)<<13);
+        }
+    } else if (exp==31) {
+        x = sign | 0x7f800000 | (mant<<13);
+    } else {
+        x = sign | ((exp - 15 + 127)<<23) | (mant<<13);
+    }
+    float f;
+    memcpy(&f, &x, 4);
+    return f;
+}
+
+#endif //__QUANTIZE_H__
@@ -0,0 +1,79 @@
+#include "renderworker.h"
+
+RenderWorker::RenderWorker() : tasks_(), pending_(), stop_(false), cancel_(false), mutex_(), cv_(), thread_(),
+                               finished_(0), cancelled_(0) {
+    thread_ = std::thread(&RenderWorker::run, this);
+}
+
+RenderWorker::~RenderWorker() {
+    stop();
+}
+
+void RenderWorker::run() {
+    while (true) {
+        Task task;
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stop_ || !tasks_.empty() || pending_; });
+            if (stop_) return;
+            if (!tasks_.empty()) {
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            } else {
+                frame = std::move(pending_);
+                pending_ = nullptr;
+                cancel_ = false; // requests from now on cancel this frame
+            }
+        }
+        if (task) {
+            task();
+            continue;
+        }
+        bool done = frame(cancel_);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (done) finished_++;
+        else cancelled_++;
+    }
+}
+
+void RenderWorker::request(Frame frame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_) return;
+        pending_ = std::move(frame); // a request nobody started yet is simply superseded
+        cancel_ = true;
+    }
+    cv_.notify_one();
+}
+
+void RenderWorker::post(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stop_) return;
+        tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void RenderWorker::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        cancel_ = true;
+        tasks_.clear();
+        pending_ = nullptr;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) thread_.join();
+}
+
+unsigned long RenderWorker::finished() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return finished_;
+}
+
+unsigned long RenderWorker::cancelled() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cancelled_;
+}
@@ -0,0 +1,41 @@
+#ifndef __RENDERWORKER_H__
+#define __RENDERWORKER_H__
+
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+// The one thread that draws. Frame requests coalesce: a new request replaces
+// the pending one and cancels the frame being drawn, so only the latest state
+// is ever finished. Tasks (picking, loading a stream, ...) run once each, in
+// order, between frames. Everything that touches the render globals goes
+// through here so the GUI thread never races the renderer.
+class RenderWorker {
+public:
+    typedef std::function<bool(const std::atomic<bool> &cancel)> Frame; // false if it gave up on cancel
+    typedef std::function<void()> Task;
+private:
+    std::deque<Task> tasks_;
+    Frame pending_;
+    bool stop_;
+    std::atomic<bool> cancel_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::thread thread_;
+    unsigned long finished_;
+    unsigned long cancelled_;
+    void run();
+public:
+    RenderWorker();
+    ~RenderWorker();
+    void request(Frame frame);
+    void post(Task task);
+    void stop(); // drops what is pending, cancels the current frame and joins
+    unsigned long finished();
+    unsigned long cancelled();
+};
+
+#endif //__RENDERWORKER_H__
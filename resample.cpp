@@ -0,0 +1,189 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "resample.h"
+#include "threadpool.h"
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+const int kRowsPerTask = 16;
+
+float filter_support(ResampleFilter filter) {
+    switch (filter) {
+    case RESAMPLE_BOX:      return .5f;
+    case RESAMPLE_BILINEAR: return 1.f;
+    default:                return 3.f;
+    }
+}
+
+float filter_weight(ResampleFilter filter, float x) {
+    x = std::fabs(x);
+    switch (filter) {
+    case RESAMPLE_BOX:
+        return x<=.5f ? 1.f : 0.f;
+    case RESAMPLE_BILINEAR:
+        return x<1.f ? 1.f-x : 0.f;
+    default:
+        if (x<1e-6f) return 1.f;
+        if (x>=3.f) return 0.f;
+        x *= 3.14159265f;
+        return 3.f*std::sin(x)*std::sin(x/3.f)/(x*x);
+    }
+}
+
+// for every destination coordinate, the source coordinates it reads and their weights
+struct Taps {
+    int ntaps;                  // per destination coordinate, unused slots weigh 0
+    std::vector<int> first;     // first source coordinate
+    std::vector<float> weights; // ntaps per destination coordinate
+
+    Taps(int src, int dst, ResampleFilter filter) {
+        float scale = (float)dst/src;
+        float stretch = std::max(1.f, 1.f/scale); // widen the filter when shrinking
+        float support = filter_support(filter)*stretch;
+        ntaps = std::min(src, (int)std::ceil(support)*2+1);
+        first.resize(dst);
+        weights.assign(dst*ntaps, 0.f);
+        for (int i=0; i<dst; i++) {
+            float center = (i+.5f)/scale;
+            int lo = std::max(0, std::min(src-ntaps, (int)std::floor(center-support)));
+            float *w = &weights[i*ntaps];
+            float sum = 0;
+            for (int k=0; k<ntaps; k++) {
+                w[k] = filter_weight(filter, (lo+k+.5f-center)/stretch);
+                sum += w[k];
+            }
+            if (sum==0) { // enlarging with the box filter between two centers
+                int nearest = std::max(lo, std::min(lo+ntaps-1, (int)center));
+                w[nearest-lo] = sum = 1.f;
+            }
+            for (int k=0; k<ntaps; k++) w[k] /= sum;
+            first[i] = lo;
+        }
+    }
+};
+
+#if defined(__SSE2__) || defined(_M_X64)
+// a pixel per register, 3 or 4 channels
+template<int BPP> void filter_row_color(const unsigned char *row, const Taps &taps, int dw, float *out) {
+    const __m128i zero = _mm_setzero_si128();
+    for (int i=0; i<dw; i++) {
+        const float *w = &taps.weights[i*taps.ntaps];
+        const unsigned char *p = row + taps.first[i]*BPP;
+        __m128 acc = _mm_setzero_ps();
+        for (int k=0; k<taps.ntaps; k++, p+=BPP) {
+            int v;
+            if (BPP==4) memcpy(&v, p, 4);
+            else v = p[0] | p[1]<<8 | p[2]<<16; // no 4 byte load, the last pixel of a row may end the buffer
+            __m128i x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_cvtepi32_ps(x)));
+        }
+        if (BPP==4 || i+1<dw) {
+            _mm_storeu_ps(out+i*BPP, acc); // the 4th lane of RGB is overwritten by the next pixel
+        } else { // the next row may belong to another task
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc);
+            memcpy(out+i*BPP, lanes, BPP*sizeof(float));
+        }
+    }
+}
+#endif
+
+// one row of the horizontal pass, dw*bpp floats into out
+void filter_row(const unsigned char *row, int bpp, const Taps &taps, int dw, float *out) {
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    if (bpp==1) { // four taps at a time, summed across lanes at the end
+        for (int i=0; i<dw; i++) {
+            const float *w = &taps.weights[i*taps.ntaps];
+            const unsigned char *p = row + taps.first[i];
+            __m128 acc = _mm_setzero_ps();
+            int k = 0;
+            for (; k+4<=taps.ntaps; k+=4) {
+                int v;
+                memcpy(&v, p+k, 4);
+                __m128i x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero), zero);
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(w+k), _mm_cvtepi32_ps(x)));
+            }
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc);
+            float sum = lanes[0]+lanes[1]+lanes[2]+lanes[3];
+            for (; k<taps.ntaps; k++) sum += w[k]*p[k];
+            out[i] = sum;
+        }
+        return;
+    }
+    if (bpp==3) {
+        filter_row_color<3>(row, taps, dw, out);
+        return;
+    }
+    if (bpp==4) {
+        filter_row_color<4>(row, taps, dw, out);
+        return;
+    }
+#endif
+    for (int i=0; i<dw; i++) {
+        const float *w = &taps.weights[i*taps.ntaps];
+        const unsigned char *p = row + taps.first[i]*bpp;
+        float acc[4] = {0, 0, 0, 0};
+        for (int k=0; k<taps.ntaps; k++, p+=bpp)
+            for (int c=0; c<bpp; c++) acc[c] += w[k]*p[c];
+        for (int c=0; c<bpp; c++) out[i*bpp+c] = acc[c];
+    }
+}
+
+}
+
+bool resample(TGAImage &src, TGAImage &dst, ResampleFilter filter) {
+    int sw = src.get_width(), sh = src.get_height();
+    int dw = dst.get_width(), dh = dst.get_height();
+    int bpp = src.get_bytespp();
+    if (sw<=0 || sh<=0 || dw<=0 || dh<=0) return false;
+    // src is only read: textures are shared through the cache and may be
+    // resampled from several threads, so it is neither normalized nor detached
+    TGAImage mirrored;
+    ImageView in;
+    if (src.flipped_horizontally()) { // a view would reverse the columns in place, work on a copy
+        mirrored = src;
+        in = mirrored.view();
+    } else {
+        in = src.read_view();
+    }
+    if (in.empty()) return false;
+    if (dst.get_bytespp()!=bpp) dst = TGAImage(dw, dh, bpp);
+    ImageView out = dst.view();
+    Taps htaps(sw, dw, filter);
+    Taps vtaps(sh, dh, filter);
+
+    // horizontal pass into a float image of dw x sh (SSE2, a pixel or four
+    // taps per register), then a vertical pass over contiguous float rows
+    std::vector<float> tmp((size_t)dw*bpp*sh);
+    ThreadPool &pool = ThreadPool::instance();
+    pool.parallel_for((sh+kRowsPerTask-1)/kRowsPerTask, [&](int task) {
+        int end = std::min(sh, (task+1)*kRowsPerTask);
+        for (int j=task*kRowsPerTask; j<end; j++)
+            filter_row(in.row(j), bpp, htaps, dw, &tmp[(size_t)j*dw*bpp]);
+    });
+    pool.parallel_for((dh+kRowsPerTask-1)/kRowsPerTask, [&](int task) {
+        int n = dw*bpp;
+        std::vector<float> acc(n);
+        int end = std::min(dh, (task+1)*kRowsPerTask);
+        for (int j=task*kRowsPerTask; j<end; j++) {
+            const float *w = &vtaps.weights[j*vtaps.ntaps];
+            std::fill(acc.begin(), acc.end(), 0.f);
+            for (int k=0; k<vtaps.ntaps; k++) {
+                const float *trow = &tmp[(size_t)(vtaps.first[j]+k)*n];
+                float wk = w[k];
+                if (wk==0) continue;
+                for (int x=0; x<n; x++) acc[x] += wk*trow[x];
+            }
+            unsigned char *orow = out.row(j);
+            for (int x=0; x<n; x++) orow[x] = (unsigned char)std::max(0.f, std::min(255.f, acc[x]+.5f));
+        }
+    });
+    return true;
+}
@@ -0,0 +1,18 @@
+#ifndef __RESAMPLE_H__
+#define __RESAMPLE_H__
+
+#include "tgaimage.h"
+
+// Separable image resampling, parallel over rows on the shared ThreadPool.
+// When shrinking the filter is stretched by the scale factor, so every source
+// pixel contributes (mip levels, thumbnails, SSAA resolve).
+enum ResampleFilter {
+    RESAMPLE_BOX,      // area average, nearest when enlarging
+    RESAMPLE_BILINEAR, // tent
+    RESAMPLE_LANCZOS3  // sharpest, may ring on hard edges
+};
+
+// dst keeps its size and format is taken from src; false if either is empty
+bool resample(TGAImage &src, TGAImage &dst, ResampleFilter filter);
+
+#endif //__RESAMPLE_H__
@@ -0,0 +1,50 @@
+#include <algorithm>
+#include "scene.h"
+
+Scene::Scene() : objects_() {
+}
+
+void Scene::add(std::shared_ptr<Model> mesh, Matrix transform, IShader *shader) {
+    if (!mesh) return;
+    SceneObject obj;
+    obj.mesh = mesh;
+    obj.transform = transform;
+    obj.shader = shader;
+    objects_.push_back(obj);
+}
+
+void Scene::clear() {
+    objects_.clear();
+}
+
+int Scene::size() {
+    return (int)objects_.size();
+}
+
+SceneObject &Scene::object(int i) {
+    return objects_[i];
+}
+
+void Scene::sort(IShader *default_shader) {
+    // diffuse_map() turns from nullptr to the texture when its decode finishes on the
+    // pool, so every key is read once: a key changing mid-sort breaks the ordering
+    struct Key {
+        IShader *shader;
+        const TGAImage *texture;
+        int index;
+    };
+    std::vector<Key> keys(objects_.size());
+    for (size_t i=0; i<objects_.size(); i++) {
+        keys[i].shader = objects_[i].shader ? objects_[i].shader : default_shader;
+        keys[i].texture = objects_[i].mesh->diffuse_map();
+        keys[i].index = (int)i;
+    }
+    std::stable_sort(keys.begin(), keys.end(), [](const Key &a, const Key &b) {
+        if (a.shader!=b.shader) return std::less<IShader *>()(a.shader, b.shader);
+        return std::less<const TGAImage *>()(a.texture, b.texture);
+    });
+    std::vector<SceneObject> sorted;
+    sorted.reserve(objects_.size());
+    for (size_t i=0; i<keys.size(); i++) sorted.push_back(std::move(objects_[keys[i].index]));
+    objects_.swap(sorted);
+}
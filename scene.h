@@ -0,0 +1,33 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include <vector>
+#include <memory>
+#include "geometry.h"
+#include "model.h"
+
+struct IShader;
+
+struct SceneObject {
+    std::shared_ptr<Model> mesh;
+    Matrix transform;  // object space -> world space
+    IShader *shader;   // nullptr means the shader chosen for the frame
+};
+
+// A set of meshes drawn into one frame with a shared depth buffer,
+// e.g. a character split into body/head/eyes files.
+class Scene {
+private:
+    std::vector<SceneObject> objects_;
+public:
+    Scene();
+    void add(std::shared_ptr<Model> mesh, Matrix transform=Matrix::identity(), IShader *shader=nullptr);
+    void clear();
+    int size();
+    SceneObject &object(int i);
+    // order objects by shader, then by diffuse texture, so consecutive draws
+    // keep the same sampler state and texture in cache
+    void sort(IShader *default_shader);
+};
+
+#endif //__SCENE_H__
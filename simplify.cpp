@@ -0,0 +1,188 @@
+#include <queue>
+#include <algorithm>
+#include "simplify.h"
+
+namespace {
+
+// symmetric 4x4 matrix, upper triangle only
+struct Quadric {
+    double q[10];
+    Quadric() { for (int i=0; i<10; i++) q[i] = 0; }
+    Quadric(double a, double b, double c, double d) {
+        q[0] = a*a; q[1] = a*b; q[2] = a*c; q[3] = a*d;
+                    q[4] = b*b; q[5] = b*c; q[6] = b*d;
+                                q[7] = c*c; q[8] = c*d;
+                                            q[9] = d*d;
+    }
+    Quadric &operator+=(const Quadric &o) { for (int i=0; i<10; i++) q[i] += o.q[i]; return *this; }
+    Quadric operator*(double s) const { Quadric r = *this; for (int i=0; i<10; i++) r.q[i] *= s; return r; }
+    double error(const Vec3f &v) const {
+        double x = v.x, y = v.y, z = v.z;
+        return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+                        +   q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+                                     +   q[7]*z*z + 2*q[8]*z
+                                                  +   q[9];
+    }
+};
+
+struct Collapse {
+    double cost;
+    int from, to;
+    unsigned int stamp_from, stamp_to; // vertex versions the cost was computed with
+    bool operator<(const Collapse &o) const { return cost>o.cost; } // min-heap
+};
+
+Vec3f face_normal(const std::vector<Vec3f> &verts, int a, int b, int c) {
+    return cross(verts[b]-verts[a], verts[c]-verts[a]);
+}
+
+}
+
+std::vector<Vec3i> simplify(const std::vector<Vec3f> &verts, const std::vector<Vec3i> &faces, int target_faces) {
+    int nverts = (int)verts.size();
+    int nfaces = (int)faces.size()/3;
+    std::vector<Vec3i> corners(faces);
+    std::vector<bool> alive(nfaces, true);
+    std::vector<std::vector<int> > vfaces(nverts);
+    std::vector<Quadric> quadrics(nverts);
+    std::vector<Vec2i> attrib(nverts, Vec2i(-1, -1)); // uv/normal of the first corner, to find seams
+    std::vector<bool> locked(nverts, false);
+    std::vector<unsigned int> stamp(nverts, 0);
+
+    for (int f=0; f<nfaces; f++) {
+        int v[3];
+        bool valid = true;
+        for (int k=0; k<3; k++) {
+            v[k] = corners[f*3+k][0];
+            valid = valid && v[k]>=0 && v[k]<nverts;
+        }
+        if (!valid || v[0]==v[1] || v[1]==v[2] || v[2]==v[0]) { alive[f] = false; continue; }
+        Vec3f n = face_normal(verts, v[0], v[1], v[2]);
+        float area2 = n.norm();
+        if (area2<=0) { alive[f] = false; continue; }
+        n = n/area2;
+        Quadric Q = Quadric(n.x, n.y, n.z, -(n*verts[v[0]]))*(area2*.5);
+        for (int k=0; k<3; k++) {
+            quadrics[v[k]] += Q;
+            vfaces[v[k]].push_back(f);
+            Vec2i a(corners[f*3+k][1], corners[f*3+k][2]);
+            if (attrib[v[k]].x<0) attrib[v[k]] = a;
+            else if (attrib[v[k]].x!=a.x || attrib[v[k]].y!=a.y) locked[v[k]] = true; // uv or normal seam
+        }
+    }
+
+    // an edge used by a single triangle is on a border
+    std::vector<std::pair<int,int> > edges;
+    for (int f=0; f<nfaces; f++) {
+        if (!alive[f]) continue;
+        for (int k=0; k<3; k++) {
+            int a = corners[f*3+k][0], b = corners[f*3+(k+1)%3][0];
+            edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    for (size_t i=0; i<edges.size(); ) {
+        size_t j = i;
+        while (j<edges.size() && edges[j]==edges[i]) j++;
+        if (j-i==1) locked[edges[i].first] = locked[edges[i].second] = true;
+        i = j;
+    }
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    std::priority_queue<Collapse> heap;
+    auto push = [&](int from, int to) {
+        if (locked[from]) return;
+        Quadric Q = quadrics[from];
+        Q += quadrics[to];
+        Collapse c;
+        c.cost = Q.error(verts[to]);
+        c.from = from;
+        c.to = to;
+        c.stamp_from = stamp[from];
+        c.stamp_to = stamp[to];
+        heap.push(c);
+    };
+    for (size_t i=0; i<edges.size(); i++) {
+        push(edges[i].first, edges[i].second);
+        push(edges[i].second, edges[i].first);
+    }
+
+    int live = 0;
+    for (int f=0; f<nfaces; f++) live += alive[f];
+    while (live>target_faces && !heap.empty()) {
+        Collapse c = heap.top();
+        heap.pop();
+        int u = c.from, v = c.to;
+        if (c.stamp_from!=stamp[u] || c.stamp_to!=stamp[v] || vfaces[u].empty()) continue;
+
+        // reject collapses that flip a surviving triangle
+        bool adjacent = false, flips = false;
+        Vec3i target(-1, -1, -1); // v as seen from a triangle on edge u-v, i.e. in u's uv chart
+
+        for (size_t i=0; i<vfaces[u].size() && !flips; i++) {
+            int f = vfaces[u][i];
+            if (!alive[f]) continue;
+            int w[3];
+            bool has_v = false;
+            for (int k=0; k<3; k++) {
+                w[k] = corners[f*3+k][0];
+                has_v = has_v || w[k]==v;
+            }
+            if (has_v) {
+                adjacent = true;
+                for (int k=0; k<3; k++) if (w[k]==v) target = corners[f*3+k];
+                continue;
+            }
+            Vec3f before = face_normal(verts, w[0], w[1], w[2]);
+            for (int k=0; k<3; k++) if (w[k]==u) w[k] = v;
+            Vec3f after = face_normal(verts, w[0], w[1], w[2]);
+            flips = before*after<=0;
+        }
+        if (!adjacent || flips) continue; // stale edge or a fold over
+
+        for (size_t i=0; i<vfaces[u].size(); i++) {
+            int f = vfaces[u][i];
+            if (!alive[f]) continue;
+            bool has_v = false;
+            for (int k=0; k<3; k++) has_v = has_v || corners[f*3+k][0]==v;
+            if (has_v) {
+                alive[f] = false;
+                live--;
+                continue;
+            }
+            for (int k=0; k<3; k++) {
+                if (corners[f*3+k][0]!=u) continue;
+                corners[f*3+k] = target; // not attrib[v]: a seam vertex v has other charts' uvs too
+            }
+            vfaces[v].push_back(f);
+        }
+        vfaces[u].clear();
+        quadrics[v] += quadrics[u];
+        stamp[u]++;
+        stamp[v]++;
+
+        // costs around v changed, queue its neighbourhood again
+        std::vector<int> ring;
+        std::vector<int> &vf = vfaces[v];
+        vf.erase(std::remove_if(vf.begin(), vf.end(), [&alive](int f) { return !alive[f]; }), vf.end());
+        for (size_t i=0; i<vf.size(); i++)
+            for (int k=0; k<3; k++) {
+                int w = corners[vf[i]*3+k][0];
+                if (w!=v) ring.push_back(w);
+            }
+        std::sort(ring.begin(), ring.end());
+        ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+        for (size_t i=0; i<ring.size(); i++) {
+            push(v, ring[i]);
+            push(ring[i], v);
+        }
+    }
+
+    std::vector<Vec3i> res;
+    res.reserve(live*3);
+    for (int f=0; f<nfaces; f++) {
+        if (!alive[f]) continue;
+        for (int k=0; k<3; k++) res.push_back(corners[f*3+k]);
+    }
+    return res;
+}
@@ -0,0 +1,16 @@
+#ifndef __SIMPLIFY_H__
+#define __SIMPLIFY_H__
+
+#include <vector>
+#include "geometry.h"
+
+// Quadric error metric edge collapse (Garland & Heckbert 97).
+// faces is a triangle index buffer of vertex/uv/normal corners as stored by
+// Model; the result references the same attribute arrays. Collapses always
+// move a vertex onto one of its neighbours, so no new vertices are created.
+// Vertices on open borders or uv seams are never removed, which keeps the
+// silhouette and the texture layout intact. Stops at target_faces triangles
+// or when no collapse is left that would not fold a triangle over.
+std::vector<Vec3i> simplify(const std::vector<Vec3f> &verts, const std::vector<Vec3i> &faces, int target_faces);
+
+#endif //__SIMPLIFY_H__
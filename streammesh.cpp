@@ -0,0 +1,402 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+#include "streammesh.h"
+#include "mmapfile.h"
+
+namespace {
+
+#pragma pack(push,1)
+struct StreamHeader {
+    char magic[4];                   // "BBSM"
+    unsigned int version;
+    unsigned int nchunks;
+    unsigned int reserved;
+    unsigned long long table_offset; // chunk table follows the triangles
+    long long source_size;           // of the OBJ it was converted from, to detect a stale file
+    long long source_mtime;
+};
+
+struct StreamChunk {
+    float bmin[3], bmax[3];
+    unsigned long long offset;
+    unsigned int ntris;
+    unsigned int reserved;
+};
+
+struct StreamVertex {
+    float pos[3];
+    float uv[2];
+    float norm[3];
+};
+#pragma pack(pop)
+
+const unsigned int kVersion = 2;
+const size_t kTriBytes = 3*sizeof(StreamVertex);
+
+// where a flush of the per-cell buffers put the triangles of one cell
+struct Segment {
+    int cell;
+    unsigned long long offset;
+    unsigned long long ntris;
+};
+
+bool remove_file(const std::string &name) {
+    return !std::remove(name.c_str());
+}
+
+// size and modification time identify the OBJ a streamed file was made from
+bool source_stamp(const char *objfile, long long &size, long long &mtime) {
+    std::error_code ec;
+    size = MappedFile::file_size(objfile);
+    mtime = (long long)std::filesystem::last_write_time(objfile, ec).time_since_epoch().count();
+    return size>=0 && !ec;
+}
+
+// the header of a complete file: chunk table at its end, chunks before the table
+bool read_header(std::ifstream &in, long long file_size, StreamHeader &header) {
+    in.read((char *)&header, sizeof(header));
+    if (!in.good() || memcmp(header.magic, "BBSM", 4) || header.version!=kVersion) return false;
+    return header.table_offset>=sizeof(header) && header.table_offset+(unsigned long long)header.nchunks*sizeof(StreamChunk)==(unsigned long long)file_size;
+}
+
+// "12/7/3" -> 12, 7, 3 (one based, 0 for a missing index)
+const char *parse_corner(const char *p, long idx[3]) {
+    idx[0] = idx[1] = idx[2] = 0;
+    char *end;
+    for (int k=0; k<3; k++) {
+        idx[k] = strtol(p, &end, 10);
+        p = end;
+        if (*p!='/') break;
+        p++;
+    }
+    return p;
+}
+
+}
+
+StreamingMesh::StreamingMesh() : filename_(), chunks_(), memory_limit_(0), bytes_streamed_(0) {
+}
+
+bool StreamingMesh::convert(const char *objfile, const char *outfile, size_t memory_limit) {
+    std::string out(outfile);
+    std::string tmp[4] = {out + ".v.tmp", out + ".vt.tmp", out + ".vn.tmp", out + ".tri.tmp"};
+    std::string part = out + ".part"; // renamed to outfile once complete, a failed run leaves nothing behind
+    long long source_size, source_mtime;
+    if (!source_stamp(objfile, source_size, source_mtime)) {
+        std::cerr << "can't open file " << objfile << "\n";
+        return false;
+    }
+    unsigned long long counts[3] = {0, 0, 0};
+    unsigned long long ntris = 0;
+    Vec3f bmin( 1e30f,  1e30f,  1e30f);
+    Vec3f bmax(-1e30f, -1e30f, -1e30f);
+
+    // pass 1: spill the attributes into flat binary arrays and count the triangles
+    {
+        std::ifstream in(objfile);
+        if (!in.is_open()) {
+            std::cerr << "can't open file " << objfile << "\n";
+            return false;
+        }
+        std::ofstream attrs[3];
+        for (int a=0; a<3; a++) attrs[a].open(tmp[a].c_str(), std::ios::binary);
+        std::string line;
+        while (std::getline(in, line)) {
+            const char *p = line.c_str();
+            int a = -1;
+            if (!line.compare(0, 2, "v "))       { a = 0; p += 2; }
+            else if (!line.compare(0, 3, "vt ")) { a = 1; p += 3; }
+            else if (!line.compare(0, 3, "vn ")) { a = 2; p += 3; }
+            else if (!line.compare(0, 2, "f ")) {
+                int corners = 0;
+                long idx[3];
+                p += 2;
+                while (*p) {
+                    while (*p==' ' || *p=='\t' || *p=='\r') p++;
+                    if (!*p) break;
+                    const char *next = parse_corner(p, idx);
+                    if (next==p) break;
+                    p = next;
+                    corners++;
+                }
+                if (corners>=3) ntris += corners-2;
+                continue;
+            }
+            if (a<0) continue;
+            float v[3] = {0, 0, 0};
+            char *end;
+            for (int k=0; k<(a==1 ? 2 : 3); k++) {
+                v[k] = strtof(p, &end);
+                p = end;
+            }
+            attrs[a].write((const char *)v, (a==1 ? 2 : 3)*sizeof(float));
+            counts[a]++;
+            if (!a) {
+                for (int k=0; k<3; k++) {
+                    bmin[k] = std::min(bmin[k], v[k]);
+                    bmax[k] = std::max(bmax[k], v[k]);
+                }
+            }
+        }
+        for (int a=0; a<3; a++) attrs[a].close();
+    }
+    if (!counts[0] || !ntris) {
+        for (int a=0; a<3; a++) remove_file(tmp[a]);
+        std::cerr << "no triangles in " << objfile << "\n";
+        return false;
+    }
+
+    // a uniform grid with cells of roughly one chunk each
+    size_t chunk_bytes = std::max<size_t>(64<<10, std::min<size_t>(16<<20, memory_limit/8));
+    unsigned long long ncells = std::max<unsigned long long>(1, ntris*kTriBytes/chunk_bytes);
+    int grid = std::max(1, std::min(64, (int)std::ceil(std::cbrt((double)ncells))));
+    Vec3f extent = bmax - bmin;
+
+    // pass 2: bin the triangles by centroid, flushing the bins to a spill file
+    // whenever they outgrow half of the memory limit
+    std::vector<Segment> segments;
+    {
+        std::ifstream in(objfile);
+        std::ofstream spill(tmp[3].c_str(), std::ios::binary);
+        MappedFile attrs[3];
+        std::vector<std::vector<StreamVertex> > bins(grid*grid*grid);
+        size_t buffered = 0;
+        unsigned long long spilled = 0;
+        auto map_attributes = [&]() {
+            // remapping lets the OS drop the pages touched so far from our working set
+            for (int a=0; a<3; a++) attrs[a].open(tmp[a].c_str());
+        };
+        auto flush = [&]() {
+            for (size_t c=0; c<bins.size(); c++) {
+                if (bins[c].empty()) continue;
+                spill.write((const char *)bins[c].data(), bins[c].size()*sizeof(StreamVertex));
+                Segment s;
+                s.cell = (int)c;
+                s.offset = spilled;
+                s.ntris = bins[c].size()/3;
+                segments.push_back(s);
+                spilled += bins[c].size()*sizeof(StreamVertex);
+                std::vector<StreamVertex>().swap(bins[c]);
+            }
+            buffered = 0;
+            map_attributes();
+        };
+        map_attributes();
+        auto fetch = [&](long idx[3], StreamVertex &v) {
+            memset(&v, 0, sizeof(v));
+            const int dims[3] = {3, 2, 3};
+            float *dst[3] = {v.pos, v.uv, v.norm};
+            for (int a=0; a<3; a++) {
+                long i = idx[a]<0 ? (long)counts[a]+idx[a] : idx[a]-1; // negative indices count from the end
+                if (i<0 || (unsigned long long)i>=counts[a] || !attrs[a].data()) continue;
+                memcpy(dst[a], attrs[a].data() + i*dims[a]*sizeof(float), dims[a]*sizeof(float));
+            }
+        };
+        std::string line;
+        std::vector<StreamVertex> poly;
+        while (std::getline(in, line)) {
+            if (line.compare(0, 2, "f ")) continue;
+            poly.clear();
+            const char *p = line.c_str()+2;
+            long idx[3];
+            while (*p) {
+                while (*p==' ' || *p=='\t' || *p=='\r') p++;
+                if (!*p) break;
+                const char *next = parse_corner(p, idx);
+                if (next==p) break;
+                p = next;
+                StreamVertex v;
+                fetch(idx, v);
+                poly.push_back(v);
+            }
+            for (size_t i=1; i+1<poly.size(); i++) { // fan, concave polygons are rare in scans
+                const StreamVertex *tri[3] = {&poly[0], &poly[i], &poly[i+1]};
+                int cell[3];
+                for (int k=0; k<3; k++) {
+                    float c = (tri[0]->pos[k] + tri[1]->pos[k] + tri[2]->pos[k])/3.f;
+                    cell[k] = extent[k]>0 ? (int)((c-bmin[k])/extent[k]*grid) : 0;
+                    cell[k] = std::max(0, std::min(grid-1, cell[k]));
+                }
+                std::vector<StreamVertex> &bin = bins[(cell[2]*grid + cell[1])*grid + cell[0]];
+                for (int k=0; k<3; k++) bin.push_back(*tri[k]);
+                buffered += kTriBytes;
+            }
+            if (buffered>memory_limit/2) flush();
+        }
+        flush();
+    }
+    for (int a=0; a<3; a++) remove_file(tmp[a]);
+
+    // pass 3: gather every cell from its segments into consecutive chunks
+    std::stable_sort(segments.begin(), segments.end(), [](const Segment &a, const Segment &b) { return a.cell<b.cell; });
+    std::ofstream outf(part.c_str(), std::ios::binary);
+    std::ifstream spill(tmp[3].c_str(), std::ios::binary);
+    if (!outf.is_open() || !spill.is_open()) {
+        remove_file(tmp[3]);
+        remove_file(part);
+        std::cerr << "can't write " << outfile << "\n";
+        return false;
+    }
+    StreamHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "BBSM", 4);
+    header.version = kVersion;
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+    outf.write((const char *)&header, sizeof(header));
+    unsigned long long written = sizeof(header);
+
+    std::vector<StreamChunk> table;
+    unsigned int max_chunk_tris = (unsigned int)std::max<size_t>(1, chunk_bytes/kTriBytes);
+    std::vector<StreamVertex> buf(std::min<unsigned long long>(max_chunk_tris, 1<<16)*3);
+    StreamChunk cur;
+    bool open_chunk = false;
+    int cur_cell = -1;
+    auto close_chunk = [&]() {
+        if (open_chunk && cur.ntris) table.push_back(cur);
+        open_chunk = false;
+    };
+    for (size_t s=0; s<segments.size(); s++) {
+        if (segments[s].cell!=cur_cell) {
+            close_chunk();
+            cur_cell = segments[s].cell;
+        }
+        spill.seekg((std::streamoff)segments[s].offset);
+        unsigned long long left = segments[s].ntris;
+        while (left) {
+            if (!open_chunk || cur.ntris==max_chunk_tris) {
+                close_chunk();
+                memset(&cur, 0, sizeof(cur));
+                for (int k=0; k<3; k++) { cur.bmin[k] = 1e30f; cur.bmax[k] = -1e30f; }
+                cur.offset = written;
+                open_chunk = true;
+            }
+            unsigned long long n = std::min<unsigned long long>(left, std::min<unsigned long long>(buf.size()/3, max_chunk_tris-cur.ntris));
+            spill.read((char *)buf.data(), n*kTriBytes);
+            if (!spill.good()) break;
+            for (size_t i=0; i<n*3; i++)
+                for (int k=0; k<3; k++) {
+                    cur.bmin[k] = std::min(cur.bmin[k], buf[i].pos[k]);
+                    cur.bmax[k] = std::max(cur.bmax[k], buf[i].pos[k]);
+                }
+            outf.write((const char *)buf.data(), n*kTriBytes);
+            written += n*kTriBytes;
+            cur.ntris += (unsigned int)n;
+            left -= n;
+        }
+    }
+    close_chunk();
+    bool spill_ok = spill.good();
+    spill.close();
+    remove_file(tmp[3]);
+
+    header.nchunks = (unsigned int)table.size();
+    header.table_offset = written;
+    outf.write((const char *)table.data(), table.size()*sizeof(StreamChunk));
+    outf.seekp(0);
+    outf.write((const char *)&header, sizeof(header));
+    outf.close();
+    remove_file(out); // rename() does not replace an existing file everywhere
+    if (!spill_ok || outf.fail() || std::rename(part.c_str(), outfile)) {
+        remove_file(part);
+        std::cerr << "can't write " << outfile << "\n";
+        return false;
+    }
+    std::cerr << "# streamed mesh " << outfile << " tris# " << ntris << " chunks# " << table.size() << " grid " << grid << "^3" << std::endl;
+    return true;
+}
+
+bool StreamingMesh::open(const char *filename, size_t memory_limit) {
+    chunks_.clear();
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    StreamHeader header;
+    if (!read_header(in, MappedFile::file_size(filename), header)) {
+        std::cerr << "not a streamed mesh " << filename << "\n";
+        return false;
+    }
+    std::vector<StreamChunk> table(header.nchunks);
+    in.seekg((std::streamoff)header.table_offset);
+    in.read((char *)table.data(), table.size()*sizeof(StreamChunk));
+    if (!in.good()) {
+        std::cerr << "an error occured while reading the chunk table\n";
+        return false;
+    }
+    for (size_t i=0; i<table.size(); i++) {
+        if (table[i].offset<sizeof(header) || table[i].offset+(unsigned long long)table[i].ntris*kTriBytes>header.table_offset) {
+            std::cerr << "bad chunk table in " << filename << "\n";
+            chunks_.clear();
+            return false;
+        }
+        Chunk c;
+        c.bmin = Vec3f(table[i].bmin[0], table[i].bmin[1], table[i].bmin[2]);
+        c.bmax = Vec3f(table[i].bmax[0], table[i].bmax[1], table[i].bmax[2]);
+        c.offset = table[i].offset;
+        c.ntris = (int)table[i].ntris;
+        chunks_.push_back(c);
+    }
+    filename_ = filename;
+    memory_limit_ = memory_limit;
+    bytes_streamed_ = 0;
+    return true;
+}
+
+bool StreamingMesh::up_to_date(const char *objfile, const char *filename) {
+    std::ifstream in(filename, std::ios::binary);
+    StreamHeader header;
+    long long size, mtime;
+    if (!in.is_open() || !read_header(in, MappedFile::file_size(filename), header)) return false;
+    if (!source_stamp(objfile, size, mtime)) return true; // the OBJ is gone, the conversion is all we have
+    return header.source_size==size && header.source_mtime==mtime;
+}
+
+int StreamingMesh::nchunks() {
+    return (int)chunks_.size();
+}
+
+const StreamingMesh::Chunk &StreamingMesh::chunk(int i) {
+    return chunks_[i];
+}
+
+int StreamingMesh::max_tris_per_load() {
+    // the mapped piece plus the Model copy (soup arrays and index buffer) live at the same time
+    size_t per_tri = kTriBytes + 3*(sizeof(Vec3f)*2 + sizeof(Vec2f) + sizeof(Vec3i));
+    return (int)std::max<size_t>(1, memory_limit_/2/per_tri);
+}
+
+bool StreamingMesh::load(int i, int first, int count, Model &out) {
+    if (i<0 || i>=nchunks() || first<0 || count<=0 || first+count>chunks_[i].ntris) return false;
+    MappedFile piece;
+    if (!piece.open(filename_.c_str(), chunks_[i].offset + (unsigned long long)first*kTriBytes, (size_t)count*kTriBytes)) {
+        std::cerr << "can't map chunk " << i << " of " << filename_ << "\n";
+        return false;
+    }
+    const StreamVertex *src = (const StreamVertex *)piece.data();
+    std::vector<Vec3f> verts(count*3), norms(count*3);
+    std::vector<Vec2f> uv(count*3);
+    for (int k=0; k<count*3; k++) {
+        verts[k] = Vec3f(src[k].pos[0], src[k].pos[1], src[k].pos[2]);
+        uv[k]    = Vec2f(src[k].uv[0], src[k].uv[1]);
+        norms[k] = Vec3f(src[k].norm[0], src[k].norm[1], src[k].norm[2]);
+    }
+    out.set_triangles(verts, uv, norms);
+    bytes_streamed_ += piece.size();
+    return true;
+}
+
+unsigned long long StreamingMesh::bytes_streamed() {
+    return bytes_streamed_;
+}
+
+void StreamingMesh::reset_bytes_streamed() {
+    bytes_streamed_ = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef __STREAMMESH_H__
+#define __STREAMMESH_H__
+
+#include <vector>
+#include <string>
+#include "geometry.h"
+#include "model.h"
+
+// Out-of-core rendering of meshes that do not fit in memory. An OBJ is
+// converted once into a file of spatially grouped chunks (uniform grid over
+// the bounds, triangles stored de-indexed); at render time chunks are mapped
+// one piece at a time and handed to the shaders as a transient Model, so the
+// working set never exceeds the memory limit.
+class StreamingMesh {
+public:
+    struct Chunk {
+        Vec3f bmin, bmax;
+        unsigned long long offset; // of the first triangle in the file
+        int ntris;
+    };
+private:
+    std::string filename_;
+    std::vector<Chunk> chunks_;
+    size_t memory_limit_;
+    unsigned long long bytes_streamed_;
+public:
+    StreamingMesh();
+    // memory_limit bounds the conversion buffers and the size of the chunks
+    static bool convert(const char *objfile, const char *outfile, size_t memory_limit);
+    // a complete conversion of objfile as it is now (same size and mtime), safe to reuse
+    static bool up_to_date(const char *objfile, const char *filename);
+    bool open(const char *filename, size_t memory_limit);
+    int nchunks();
+    const Chunk &chunk(int i);
+    int max_tris_per_load(); // largest piece load() may be asked for under the memory limit
+    // replaces the geometry of out by triangles [first, first+count) of chunk i
+    bool load(int i, int first, int count, Model &out);
+    unsigned long long bytes_streamed(); // since the last reset, e.g. per frame
+    void reset_bytes_streamed();
+};
+
+#endif //__STREAMMESH_H__
@@ -0,0 +1,165 @@
+#include <iostream>
+#include <filesystem>
+#include <cstdio>
+#include <cstring>
+#include "texturecache.h"
+#include "mmapfile.h"
+
+namespace {
+
+// FNV-1a over 8 byte words, the tail byte by byte
+unsigned long long hash_bytes(const unsigned char *p, size_t n) {
+    unsigned long long h = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+        unsigned long long w;
+        memcpy(&w, p+i, 8);
+        h = (h^w)*1099511628211ull;
+    }
+    for (; i<n; i++) h = (h^p[i])*1099511628211ull;
+    return h;
+}
+
+bool same_contents(const std::string &a, const std::string &b) {
+    MappedFile fa, fb;
+    if (!fa.open(a.c_str()) || !fb.open(b.c_str())) return false;
+    return fa.size()==fb.size() && !memcmp(fa.data(), fb.data(), fa.size());
+}
+
+}
+
+TextureCache::TextureCache() : entries_(), mutex_(), budget_(256ull<<20), clock_(0), stats_() {
+}
+
+TextureCache &TextureCache::instance() {
+    static TextureCache cache;
+    return cache;
+}
+
+// "size:hash" of the file, hashed again only when its size or mtime changed;
+// the path itself if it can not be read (the decode will report it)
+std::string TextureCache::content_key(const std::string &path) {
+    std::error_code ec;
+    long long size = MappedFile::file_size(path.c_str());
+    long long mtime = (long long)std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+    if (size<0 || ec) return path;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = paths_.find(path);
+        if (it!=paths_.end() && it->second.size==size && it->second.mtime==mtime) return it->second.content;
+    }
+    MappedFile file;
+    if (!file.open(path.c_str())) return path;
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%llu:%016llx", (unsigned long long)file.size(), hash_bytes(file.data(), file.size()));
+    Path p;
+    p.size = size;
+    p.mtime = mtime;
+    p.content = buf;
+    std::lock_guard<std::mutex> lock(mutex_);
+    paths_[path] = p;
+    return p.content;
+}
+
+std::shared_ptr<TGAImage> TextureCache::acquire(const std::string &filename) {
+    std::error_code ec;
+    std::string path = std::filesystem::weakly_canonical(filename, ec).string();
+    if (ec) path = filename;
+    std::string key = content_key(path); // copies of a file under other names share the entry
+
+    std::promise<std::shared_ptr<TGAImage> > promise;
+    std::shared_future<std::shared_ptr<TGAImage> > pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        // the hash only finds candidates: a copy under another name must match byte for byte
+        // the file the entry was decoded from, a collision is cached under its own path
+        if (it!=entries_.end() && it->second.source!=path && !same_contents(it->second.source, path)) {
+            key = path;
+            it = entries_.find(key);
+        }
+        if (it!=entries_.end()) {
+            stats_.hits++;
+            it->second.last_used = ++clock_;
+            pending = it->second.image;
+        } else {
+            stats_.misses++;
+            Entry e;
+            e.image = promise.get_future().share();
+            e.bytes = 0;
+            e.last_used = ++clock_;
+            e.source = path;
+            entries_[key] = e;
+        }
+    }
+    if (pending.valid()) return pending.get(); // decoded (or being decoded) by someone else
+
+    // decode outside of the lock, concurrent requests for the same key wait on the future
+    std::shared_ptr<TGAImage> img = std::make_shared<TGAImage>();
+    if (img->read_tga_file(path.c_str(), true)) {
+        img->flip_vertically();
+    } else {
+        img.reset();
+    }
+    promise.set_value(img);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (!img) {
+        entries_.erase(it); // do not cache failures, the file may show up later
+        return img;
+    }
+    it->second.bytes = (unsigned long long)img->get_width()*img->get_height()*img->get_bytespp();
+    stats_.bytes_loaded   += it->second.bytes;
+    stats_.bytes_resident += it->second.bytes;
+    trim_locked();
+    return img;
+}
+
+void TextureCache::touch(const TGAImage *img) {
+    if (!img) return;
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++clock_;
+    for (auto it=entries_.begin(); it!=entries_.end(); ++it) {
+        std::shared_future<std::shared_ptr<TGAImage> > &f = it->second.image;
+        if (f.wait_for(std::chrono::seconds(0))==std::future_status::ready && f.get().get()==img) {
+            it->second.last_used = clock_;
+            return;
+        }
+    }
+}
+
+void TextureCache::set_budget(unsigned long long bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = bytes;
+    trim_locked();
+}
+
+void TextureCache::trim() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    trim_locked();
+}
+
+void TextureCache::trim_locked() {
+    while (stats_.bytes_resident>budget_) {
+        auto victim = entries_.end();
+        for (auto it=entries_.begin(); it!=entries_.end(); ++it) {
+            std::shared_future<std::shared_ptr<TGAImage> > &f = it->second.image;
+            if (f.wait_for(std::chrono::seconds(0))!=std::future_status::ready) continue;
+            if (f.get().use_count()>1) continue; // still referenced by a model (the future holds one)
+            if (victim==entries_.end() || it->second.last_used<victim->second.last_used) victim = it;
+        }
+        if (victim==entries_.end()) return; // everything resident is in use
+        stats_.bytes_resident -= victim->second.bytes;
+        stats_.evictions++;
+        entries_.erase(victim);
+    }
+}
+
+TextureCache::Stats TextureCache::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats s = stats_;
+    s.budget = budget_;
+    s.entries = (int)entries_.size();
+    return s;
+}
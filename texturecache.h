@@ -0,0 +1,61 @@
+#ifndef __TEXTURECACHE_H__
+#define __TEXTURECACHE_H__
+
+#include <map>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <future>
+#include "tgaimage.h"
+
+// Process-wide texture manager. Textures are keyed by file contents (size and
+// a 64 bit hash, checked byte by byte against the file an entry was decoded
+// from), so every model referencing the same file, or a copy of it under
+// another name, shares one decoded copy; users hold a shared_ptr and the
+// reference count tells the cache which entries are idle.
+// Idle entries are evicted least-recently-sampled first once the resident
+// size exceeds the byte budget.
+class TextureCache {
+public:
+    struct Stats {
+        unsigned long hits;
+        unsigned long misses;
+        unsigned long evictions;
+        unsigned long long bytes_loaded;   // total decoded since start
+        unsigned long long bytes_resident; // currently held by the cache
+        unsigned long long budget;
+        int entries;
+    };
+private:
+    struct Entry {
+        std::shared_future<std::shared_ptr<TGAImage> > image;
+        unsigned long long bytes;
+        unsigned long last_used;
+        std::string source; // canonical path the image is decoded from
+    };
+    // a canonical path and the contents it had when it was last hashed
+    struct Path {
+        long long size;
+        long long mtime;
+        std::string content;
+    };
+    std::map<std::string, Entry> entries_; // by content key
+    std::map<std::string, Path> paths_;
+    std::mutex mutex_;
+    unsigned long long budget_;
+    unsigned long clock_;
+    Stats stats_;
+    TextureCache();
+    void trim_locked();
+    std::string content_key(const std::string &path);
+public:
+    static TextureCache &instance();
+    // returns the decoded texture (flipped to bottom-left uv origin), nullptr if it can not be read
+    std::shared_ptr<TGAImage> acquire(const std::string &filename);
+    void touch(const TGAImage *img); // mark as sampled in the current frame
+    void set_budget(unsigned long long bytes);
+    void trim();
+    Stats stats();
+};
+
+#endif //__TEXTURECACHE_H__
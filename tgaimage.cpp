@@ -3,44 +3,205 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <new>
 #include "tgaimage.h"
+#include "mmapfile.h"
+#include "threadpool.h"
+#include "resample.h"
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
-TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {
+// the buffer starts on a cache line; rows are packed (width*bytespp apart) so only
+// row 0 is aligned, and mapped or adopted pixels keep whatever alignment they have
+static unsigned char *alloc_pixels(unsigned long nbytes) {
+    return (unsigned char *)::operator new[](nbytes, std::align_val_t(TGAImage::ALIGNMENT));
+}
 
+static void free_pixels(unsigned char *p) {
+    ::operator delete[](p, std::align_val_t(TGAImage::ALIGNMENT));
 }
 
-TGAImage::TGAImage(int w, int h, int bpp) : data(NULL), width(w), height(h), bytespp(bpp) {
+TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0), mapping(), external(), flipped_x(false), flipped_y(false) {
+
+}
+
+TGAImage::TGAImage(int w, int h, int bpp) : data(NULL), width(w), height(h), bytespp(bpp), mapping(), external(), flipped_x(false), flipped_y(false) {
     unsigned long nbytes = width*height*bytespp;
-    data = new unsigned char[nbytes];
+    data = alloc_pixels(nbytes);
     memset(data, 0, nbytes);
 }
 
-TGAImage::TGAImage(const TGAImage &img) : data(NULL), width(img.width), height(img.height), bytespp(img.bytespp) {
+TGAImage::TGAImage(const TGAImage &img) : data(NULL), width(img.width), height(img.height), bytespp(img.bytespp), mapping(img.mapping), external(), flipped_x(img.flipped_x), flipped_y(img.flipped_y) {
+    if (mapping) { // the pages are read-only, share them
+        data = img.data;
+        return;
+    }
+    if (!img.data) return;
     unsigned long nbytes = width*height*bytespp;
-    data = new unsigned char[nbytes];
+    data = alloc_pixels(nbytes);
     memcpy(data, img.data, nbytes);
 }
 
+TGAImage::TGAImage(TGAImage &&img) : data(img.data), width(img.width), height(img.height), bytespp(img.bytespp), mapping(std::move(img.mapping)), external(std::move(img.external)), flipped_x(img.flipped_x), flipped_y(img.flipped_y) {
+    img.data = NULL;
+    img.width = img.height = img.bytespp = 0;
+    img.release();
+}
+
 TGAImage::~TGAImage() {
-    if (data) delete [] data;
+    release();
+}
+
+void TGAImage::release() {
+    if (data && !mapping && !external) free_pixels(data);
+    data = NULL;
+    mapping.reset();
+    external.reset();
+    flipped_x = flipped_y = false;
 }
 
 TGAImage & TGAImage::operator =(const TGAImage &img) {
     if (this != &img) {
-        if (data) delete [] data;
+        release();
         width  = img.width;
         height = img.height;
         bytespp = img.bytespp;
+        flipped_x = img.flipped_x;
+        flipped_y = img.flipped_y;
+        if (img.mapping) {
+            mapping = img.mapping;
+            data = img.data;
+            return *this;
+        }
+        if (!img.data) return *this;
         unsigned long nbytes = width*height*bytespp;
-        data = new unsigned char[nbytes];
-        memcpy(data, img.data, nbytes);
+        data = alloc_pixels(nbytes);
+        memcpy(data, img.data, nbytes); // adopted buffers are copied too, they are writable
     }
     return *this;
 }
 
-bool TGAImage::read_tga_file(const char *filename) {
-    if (data) delete [] data;
-    data = NULL;
+TGAImage & TGAImage::operator =(TGAImage &&img) {
+    if (this != &img) {
+        release();
+        data = img.data;
+        width  = img.width;
+        height = img.height;
+        bytespp = img.bytespp;
+        mapping = std::move(img.mapping);
+        external = std::move(img.external);
+        flipped_x = img.flipped_x;
+        flipped_y = img.flipped_y;
+        img.data = NULL;
+        img.width = img.height = img.bytespp = 0;
+        img.release();
+    }
+    return *this;
+}
+
+void TGAImage::adopt(unsigned char *pixels, int w, int h, int bpp, std::function<void(unsigned char *)> deleter) {
+    release();
+    data = pixels;
+    width = w;
+    height = h;
+    bytespp = bpp;
+    external = std::shared_ptr<unsigned char>(pixels, [deleter](unsigned char *p) { if (deleter) deleter(p); });
+}
+
+bool TGAImage::mapped() {
+    return (bool)mapping;
+}
+
+unsigned char *TGAImage::pixel(int x, int y) {
+    if (flipped_x) x = width-1-x;
+    if (flipped_y) y = height-1-y;
+    return data+(x+y*width)*bytespp;
+}
+
+// the stored order is kept, only the pages become writable
+bool TGAImage::detach() {
+    if (!mapping) return true;
+    unsigned long nbytes = width*height*bytespp;
+    unsigned char *owned = alloc_pixels(nbytes);
+    memcpy(owned, data, nbytes);
+    mapping.reset();
+    data = owned;
+    return true;
+}
+
+// swaps row j with row height-1-j, in place
+void TGAImage::reverse_rows() {
+    unsigned long bytes_per_line = width*bytespp;
+    for (int j=0; j<height/2; j++)
+        std::swap_ranges(data+j*bytes_per_line, data+(j+1)*bytes_per_line, data+(height-1-j)*bytes_per_line);
+}
+
+// reverses the pixels of every row, in place
+void TGAImage::reverse_columns() {
+    for (int j=0; j<height; j++) {
+        unsigned char *row = data+(unsigned long)j*width*bytespp;
+        if (1==bytespp) {
+            std::reverse(row, row+width);
+        } else if (4==bytespp) {
+            // memcpy loads: adopted buffers need not be 4 byte aligned
+            for (int a=0, b=width-1; a<b; a++, b--) {
+                uint32_t pa, pb;
+                memcpy(&pa, row+a*4, 4);
+                memcpy(&pb, row+b*4, 4);
+                memcpy(row+a*4, &pb, 4);
+                memcpy(row+b*4, &pa, 4);
+            }
+        } else {
+            for (int a=0, b=width-1; a<b; a++, b--)
+                std::swap_ranges(row+a*bytespp, row+(a+1)*bytespp, row+b*bytespp);
+        }
+    }
+}
+
+// applies the pending flips to the pixels, for code that walks the buffer top-down
+bool TGAImage::normalize() {
+    if (!data) return false;
+    if (!flipped_x && !flipped_y) return true;
+    detach();
+    if (flipped_y) reverse_rows();
+    if (flipped_x) reverse_columns();
+    flipped_x = flipped_y = false;
+    return true;
+}
+
+// bytes from the start of the file to the pixel data
+static unsigned long payload_offset(const TGA_Header &header) {
+    unsigned long offset = sizeof(header) + (unsigned char)header.idlength;
+    if (header.colormaptype) offset += (unsigned short)header.colormaplength*(((unsigned char)header.colormapdepth+7)>>3);
+    return offset;
+}
+
+// points data at the pixel payload of the file, nothing is copied
+bool TGAImage::map_tga_file(const char *filename, const TGA_Header &header) {
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(filename)) return false;
+    unsigned long offset = payload_offset(header);
+    unsigned long nbytes = bytespp*width*height;
+    if (file->size()<offset || file->size()-offset<nbytes) {
+        std::cerr << "an error occured while reading the data\n";
+        return false;
+    }
+    mapping = file;
+    data = const_cast<unsigned char *>(file->data()+offset); // written only after detach()
+    flipped_y = !(header.imagedescriptor & 0x20);
+    flipped_x = (header.imagedescriptor & 0x10)!=0;
+    return true;
+}
+
+bool TGAImage::read_tga_file(const char *filename, bool map) {
+    release();
     std::ifstream in;
     in.open (filename, std::ios::binary);
     if (!in.is_open()) {
@@ -63,9 +224,19 @@ bool TGAImage::read_tga_file(const char *filename) {
         std::cerr << "bad bpp (or width/height) value\n";
         return false;
     }
+    if (map && (3==header.datatypecode || 2==header.datatypecode)) {
+        in.close();
+        if (map_tga_file(filename, header)) {
+            std::cerr << width << "x" << height << "/" << bytespp*8 << " mapped\n";
+            return true;
+        }
+        in.open(filename, std::ios::binary); // fall back to reading it
+        in.read((char *)&header, sizeof(header));
+    }
     unsigned long nbytes = bytespp*width*height;
-    data = new unsigned char[nbytes];
+    data = alloc_pixels(nbytes);
     if (3==header.datatypecode || 2==header.datatypecode) {
+        in.seekg(payload_offset(header)); // past the image id and the colour map
         in.read((char *)data, nbytes);
         if (!in.good()) {
             in.close();
@@ -73,7 +244,33 @@ bool TGAImage::read_tga_file(const char *filename) {
             return false;
         }
     } else if (10==header.datatypecode||11==header.datatypecode) {
-        if (!load_rle_data(in)) {
+        // decode from memory: the mapped file, or the rest of it read in one go
+        in.close();
+        unsigned long offset = payload_offset(header);
+        MappedFile file;
+        std::vector<unsigned char> buf;
+        const unsigned char *payload = NULL;
+        unsigned long length = 0;
+        if (file.open(filename) && file.size()>=offset) {
+            payload = file.data()+offset;
+            length = file.size()-offset;
+        } else {
+            long long size = MappedFile::file_size(filename);
+            in.open(filename, std::ios::binary);
+            if (size>=(long long)offset) {
+                buf.resize(size-offset);
+                in.seekg(offset);
+                in.read((char *)buf.data(), buf.size());
+            }
+            if (!in.good() || buf.empty()) {
+                in.close();
+                std::cerr << "an error occured while reading the data\n";
+                return false;
+            }
+            payload = buf.data();
+            length = buf.size();
+        }
+        if (!load_rle_data(payload, length)) {
             in.close();
             std::cerr << "an error occured while reading the data\n";
             return false;
@@ -83,70 +280,58 @@ bool TGAImage::read_tga_file(const char *filename) {
         std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
         return false;
     }
-    if (!(header.imagedescriptor & 0x20)) {
-        flip_vertically();
-    }
-    if (header.imagedescriptor & 0x10) {
-        flip_horizontally();
-    }
+    flipped_y = !(header.imagedescriptor & 0x20); // no pass over the pixels, see pixel()
+    flipped_x = (header.imagedescriptor & 0x10)!=0;
     std::cerr << width << "x" << height << "/" << bytespp*8 << "\n";
     in.close();
     return true;
 }
 
-bool TGAImage::load_rle_data(std::ifstream &in) {
-    unsigned long pixelcount = width*height;
-    unsigned long currentpixel = 0;
-    unsigned long currentbyte  = 0;
-    TGAColor colorbuffer;
-    do {
-        unsigned char chunkheader = 0;
-        chunkheader = in.get();
-        if (!in.good()) {
+// raw packets are copied whole, runs are filled by doubling the written prefix
+bool TGAImage::load_rle_data(const unsigned char *in, unsigned long nbytes) {
+    unsigned long total = (unsigned long)width*height*bytespp;
+    unsigned char *out = data;
+    unsigned char *end = data+total;
+    const unsigned char *inend = in+nbytes;
+    while (out<end) {
+        if (in>=inend) {
             std::cerr << "an error occured while reading the data\n";
             return false;
         }
+        unsigned char chunkheader = *in++;
+        unsigned long npixels = (chunkheader&0x7f)+1;
+        unsigned long length = npixels*bytespp;
+        if (length>(unsigned long)(end-out)) {
+            std::cerr << "Too many pixels read\n";
+            return false;
+        }
         if (chunkheader<128) {
-            chunkheader++;
-            for (int i=0; i<chunkheader; i++) {
-                in.read((char *)colorbuffer.bgra, bytespp);
-                if (!in.good()) {
-                    std::cerr << "an error occured while reading the header\n";
-                    return false;
-                }
-                for (int t=0; t<bytespp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
-                currentpixel++;
-                if (currentpixel>pixelcount) {
-                    std::cerr << "Too many pixels read\n";
-                    return false;
-                }
+            if (length>(unsigned long)(inend-in)) {
+                std::cerr << "an error occured while reading the data\n";
+                return false;
             }
+            memcpy(out, in, length);
+            in += length;
         } else {
-            chunkheader -= 127;
-            in.read((char *)colorbuffer.bgra, bytespp);
-            if (!in.good()) {
-                std::cerr << "an error occured while reading the header\n";
+            if ((unsigned long)bytespp>(unsigned long)(inend-in)) {
+                std::cerr << "an error occured while reading the data\n";
                 return false;
             }
-            for (int i=0; i<chunkheader; i++) {
-                for (int t=0; t<bytespp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
-                currentpixel++;
-                if (currentpixel>pixelcount) {
-                    std::cerr << "Too many pixels read\n";
-                    return false;
-                }
+            if (1==bytespp) {
+                memset(out, *in, npixels);
+            } else {
+                memcpy(out, in, bytespp);
+                for (unsigned long filled=bytespp; filled<length; filled<<=1)
+                    memcpy(out+filled, out, std::min(filled, length-filled));
             }
+            in += bytespp;
         }
-    } while (currentpixel < pixelcount);
+        out += length;
+    }
     return true;
 }
 
 bool TGAImage::write_tga_file(const char *filename, bool rle) {
-    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
-    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
-    unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
     std::ofstream out;
     out.open (filename, std::ios::binary);
     if (!out.is_open()) {
@@ -154,110 +339,140 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
         out.close();
         return false;
     }
+    // the whole file is assembled in memory and written at once
+    std::vector<unsigned char> file;
+    encode_tga(file, rle);
+    out.write((char *)file.data(), file.size());
+    if (!out.good()) {
+        std::cerr << "can't dump the tga file\n";
+        out.close();
+        return false;
+    }
+    out.close();
+    return true;
+}
+
+void TGAImage::encode_tga(std::vector<unsigned char> &file, bool rle) {
+    unsigned char developer_area_ref[4] = {0, 0, 0, 0};
+    unsigned char extension_area_ref[4] = {0, 0, 0, 0};
+    unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
     TGA_Header header;
     memset((void *)&header, 0, sizeof(header));
     header.bitsperpixel = bytespp<<3;
     header.width  = width;
     header.height = height;
     header.datatypecode = (bytespp==GRAYSCALE?(rle?11:3):(rle?10:2));
-    header.imagedescriptor = 0x20; // top-left origin
-    out.write((char *)&header, sizeof(header));
-    if (!out.good()) {
-        out.close();
-        std::cerr << "can't dump the tga file\n";
-        return false;
-    }
+    header.imagedescriptor = (flipped_y?0:0x20) | (flipped_x?0x10:0); // the order the pixels are stored in
+
+    unsigned long nbytes = (unsigned long)width*height*bytespp;
+    file.resize(sizeof(header));
+    memcpy(file.data(), &header, sizeof(header));
     if (!rle) {
-        out.write((char *)data, width*height*bytespp);
-        if (!out.good()) {
-            std::cerr << "can't unload raw data\n";
-            out.close();
-            return false;
-        }
+        file.insert(file.end(), data, data+nbytes);
     } else {
-        if (!unload_rle_data(out)) {
-            out.close();
-            std::cerr << "can't unload rle data\n";
-            return false;
-        }
+        // row strips are encoded in parallel into their own buffers, packets never span two strips
+        unsigned long bytes_per_line = (unsigned long)width*bytespp;
+        int rows = std::max(16, height/(ThreadPool::instance().size()*4));
+        int nstrips = (height+rows-1)/rows;
+        std::vector<std::vector<unsigned char> > strips(nstrips);
+        ThreadPool::instance().parallel_for(nstrips, [&](int k) {
+            int nrows = std::min(rows, height-k*rows);
+            unsigned long npixels = (unsigned long)nrows*width;
+            strips[k].resize(npixels*bytespp + (npixels+127)/128); // worst case, all raw
+            strips[k].resize(unload_rle_data(data+k*rows*bytes_per_line, npixels, strips[k].data()));
+        });
+        for (int k=0; k<nstrips; k++) file.insert(file.end(), strips[k].begin(), strips[k].end());
     }
-    out.write((char *)developer_area_ref, sizeof(developer_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
-    out.write((char *)extension_area_ref, sizeof(extension_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
-    out.write((char *)footer, sizeof(footer));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
+    file.insert(file.end(), developer_area_ref, developer_area_ref+sizeof(developer_area_ref));
+    file.insert(file.end(), extension_area_ref, extension_area_ref+sizeof(extension_area_ref));
+    file.insert(file.end(), footer, footer+sizeof(footer));
+}
+
+// index of the lowest set bit, x must not be 0
+static inline int lowest_bit(unsigned int x) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return (int)i;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+// number of pixels equal to the first one, at most n; pixel i+1 equals pixel i
+// exactly when the bytes match the same bytes shifted by one pixel
+static unsigned long equal_run(const unsigned char *p, unsigned long n, int bytespp) {
+    if (n<2 || memcmp(p, p+bytespp, bytespp)) return 1; // the common case in noisy textures
+    unsigned long nbytes = (n-1)*bytespp; // bytes to compare against their successor pixel
+    unsigned long k = bytespp;
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; k+16<=nbytes; k+=16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p+k));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p+k+bytespp));
+        unsigned int neq = ~_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) & 0xffff;
+        if (neq) {
+            k += lowest_bit(neq);
+            return k/bytespp + 1;
+        }
     }
-    out.close();
-    return true;
+#endif
+    for (; k<nbytes; k++)
+        if (p[k]!=p[k+bytespp]) return k/bytespp + 1;
+    return n;
 }
 
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out) {
-    const unsigned char max_chunk_length = 128;
-    unsigned long npixels = width*height;
+// encodes npixels into out, returns the number of bytes written. A run packet
+// replaces r pixels of raw data (r*bytespp bytes) by 1+bytespp bytes, plus one
+// more header when it splits a raw packet in two; it is used only when smaller.
+unsigned long TGAImage::unload_rle_data(const unsigned char *pixels, unsigned long npixels, unsigned char *out) {
+    const unsigned long max_chunk_length = 128;
+    unsigned char *start = out;
+    unsigned long raw_start = 0;
     unsigned long curpix = 0;
+    auto flush_raw = [&](unsigned long end) {
+        while (raw_start<end) {
+            unsigned long n = std::min(max_chunk_length, end-raw_start);
+            *out++ = (unsigned char)(n-1);
+            memcpy(out, pixels+raw_start*bytespp, n*bytespp);
+            out += n*bytespp;
+            raw_start += n;
+        }
+    };
     while (curpix<npixels) {
-        unsigned long chunkstart = curpix*bytespp;
-        unsigned long curbyte = curpix*bytespp;
-        unsigned char run_length = 1;
-        bool raw = true;
-        while (curpix+run_length<npixels && run_length<max_chunk_length) {
-            bool succ_eq = true;
-            for (int t=0; succ_eq && t<bytespp; t++) {
-                succ_eq = (data[curbyte+t]==data[curbyte+t+bytespp]);
+        unsigned long run = equal_run(pixels+curpix*bytespp, npixels-curpix, bytespp);
+        bool splits_raw = raw_start<curpix && curpix+run<npixels;
+        if (run>1 && run*bytespp>(unsigned long)(1+bytespp+(splits_raw?1:0))) {
+            flush_raw(curpix);
+            for (unsigned long left=run; left; ) {
+                unsigned long n = std::min(max_chunk_length, left);
+                *out++ = (unsigned char)(n+127);
+                memcpy(out, pixels+curpix*bytespp, bytespp);
+                out += bytespp;
+                left -= n;
             }
-            curbyte += bytespp;
-            if (1==run_length) {
-                raw = !succ_eq;
-            }
-            if (raw && succ_eq) {
-                run_length--;
-                break;
-            }
-            if (!raw && !succ_eq) {
-                break;
-            }
-            run_length++;
-        }
-        curpix += run_length;
-        out.put(raw?run_length-1:run_length+127);
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
-        }
-        out.write((char *)(data+chunkstart), (raw?run_length*bytespp:bytespp));
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
+            curpix += run;
+            raw_start = curpix;
+        } else {
+            curpix += run; // too short to pay for a packet, stays raw
         }
     }
-    return true;
+    flush_raw(npixels);
+    return out-start;
 }
 
 TGAColor TGAImage::get(int x, int y) {
     if (!data || x<0 || y<0 || x>=width || y>=height) {
         return TGAColor();
     }
-    return TGAColor(data+(x+y*width)*bytespp, bytespp);
+    return TGAColor(pixel(x, y), bytespp);
 }
 
 bool TGAImage::set(int x, int y, TGAColor &c) {
     if (!data || x<0 || y<0 || x>=width || y>=height) {
         return false;
     }
-    memcpy(data+(x+y*width)*bytespp, c.bgra, bytespp);
+    detach();
+    memcpy(pixel(x, y), c.bgra, bytespp);
     return true;
 }
 
@@ -265,7 +480,8 @@ bool TGAImage::set(int x, int y, const TGAColor &c) {
     if (!data || x<0 || y<0 || x>=width || y>=height) {
         return false;
     }
-    memcpy(data+(x+y*width)*bytespp, c.bgra, bytespp);
+    detach();
+    memcpy(pixel(x, y), c.bgra, bytespp);
     return true;
 }
 
@@ -283,75 +499,87 @@ int TGAImage::get_height() {
 
 bool TGAImage::flip_horizontally() {
     if (!data) return false;
-    int half = width>>1;
-    for (int i=0; i<half; i++) {
-        for (int j=0; j<height; j++) {
-            TGAColor c1 = get(i, j);
-            TGAColor c2 = get(width-1-i, j);
-            set(i, j, c2);
-            set(width-1-i, j, c1);
-        }
-    }
+    flipped_x = !flipped_x;
     return true;
 }
 
 bool TGAImage::flip_vertically() {
     if (!data) return false;
-    unsigned long bytes_per_line = width*bytespp;
-    unsigned char *line = new unsigned char[bytes_per_line];
-    int half = height>>1;
-    for (int j=0; j<half; j++) {
-        unsigned long l1 = j*bytes_per_line;
-        unsigned long l2 = (height-1-j)*bytes_per_line;
-        memmove((void *)line,      (void *)(data+l1), bytes_per_line);
-        memmove((void *)(data+l1), (void *)(data+l2), bytes_per_line);
-        memmove((void *)(data+l2), (void *)line,      bytes_per_line);
-    }
-    delete [] line;
+    flipped_y = !flipped_y;
     return true;
 }
 
+bool TGAImage::flipped_horizontally() {
+    return flipped_x;
+}
+
+bool TGAImage::flipped_vertically() {
+    return flipped_y;
+}
+
+ImageView ImageView::sub(int x, int y, int w, int h) const {
+    int x1 = std::min(width, x+w), y1 = std::min(height, y+h);
+    x = std::max(0, x);
+    y = std::max(0, y);
+    if (empty() || x>=x1 || y>=y1) return ImageView();
+    return ImageView(pixel(x, y), x1-x, y1-y, stride, bytespp);
+}
+
+void ImageView::fill(const TGAColor &c) const {
+    if (empty()) return;
+    unsigned char *first = row(0);
+    for (int x=0; x<width; x++) memcpy(first+x*bytespp, c.bgra, bytespp);
+    for (int y=1; y<height; y++) memcpy(row(y), first, (size_t)width*bytespp);
+}
+
+bool ImageView::copy_from(const ImageView &src) const {
+    if (src.width!=width || src.height!=height || src.bytespp!=bytespp) return false;
+    for (int y=0; y<height; y++) memcpy(row(y), src.row(y), (size_t)width*bytespp);
+    return true;
+}
+
+ImageView TGAImage::view() {
+    if (!data) return ImageView();
+    detach();
+    if (flipped_x) {
+        reverse_columns();
+        flipped_x = false;
+    }
+    long bytes_per_line = (long)width*bytespp;
+    if (flipped_y) return ImageView(data+(height-1)*bytes_per_line, width, height, -bytes_per_line, bytespp);
+    return ImageView(data, width, height, bytes_per_line, bytespp);
+}
+
+ImageView TGAImage::view(int x, int y, int w, int h) {
+    return view().sub(x, y, w, h);
+}
+
+ImageView TGAImage::read_view() {
+    if (!data || flipped_x) return view();
+    long bytes_per_line = (long)width*bytespp;
+    if (flipped_y) return ImageView(data+(height-1)*bytes_per_line, width, height, -bytes_per_line, bytespp);
+    return ImageView(data, width, height, bytes_per_line, bytespp);
+}
+
 unsigned char *TGAImage::buffer() {
+    normalize();
     return data;
 }
 
 void TGAImage::clear() {
+    if (mapping) {
+        release();
+        data = alloc_pixels(width*height*bytespp);
+    }
+    flipped_x = flipped_y = false;
     memset((void *)data, 0, width*height*bytespp);
 }
 
+// area average when shrinking, nearest when enlarging, see resample.h for the other filters
 bool TGAImage::scale(int w, int h) {
     if (w<=0 || h<=0 || !data) return false;
-    unsigned char *tdata = new unsigned char[w*h*bytespp];
-    int nscanline = 0;
-    int oscanline = 0;
-    int erry = 0;
-    unsigned long nlinebytes = w*bytespp;
-    unsigned long olinebytes = width*bytespp;
-    for (int j=0; j<height; j++) {
-        int errx = width-w;
-        int nx   = -bytespp;
-        int ox   = -bytespp;
-        for (int i=0; i<width; i++) {
-            ox += bytespp;
-            errx += w;
-            while (errx>=(int)width) {
-                errx -= width;
-                nx += bytespp;
-                memcpy(tdata+nscanline+nx, data+oscanline+ox, bytespp);
-            }
-        }
-        erry += h;
-        oscanline += olinebytes;
-        while (erry>=(int)height) {
-            if (erry>=(int)height<<1) // it means we jump over a scanline
-                memcpy(tdata+nscanline+nlinebytes, tdata+nscanline, nlinebytes);
-            erry -= height;
-            nscanline += nlinebytes;
-        }
-    }
-    delete [] data;
-    data = tdata;
-    width = w;
-    height = h;
+    TGAImage scaled(w, h, bytespp);
+    if (!resample(*this, scaled, RESAMPLE_BOX)) return false;
+    *this = std::move(scaled);
     return true;
 }
@@ -2,6 +2,9 @@
 #define __IMAGE_H__
 
 #include <fstream>
+#include <memory>
+#include <functional>
+#include <vector>
 
 #pragma pack(push,1)
 struct TGA_Header {
@@ -63,37 +66,95 @@ struct TGAColor {
 };
 
 
+// Non-owning window into pixel rows: the whole image or a rectangle of it.
+// stride is the byte distance from one row to the next and is negative when
+// the rows are stored bottom-up, so row(0) is always the top row. A view is
+// valid as long as the image it came from is not reallocated or remapped.
+struct ImageView {
+    unsigned char *data; // first pixel of the top row
+    int width;
+    int height;
+    long stride;
+    int bytespp;
+
+    ImageView() : data(NULL), width(0), height(0), stride(0), bytespp(0) {}
+    ImageView(unsigned char *p, int w, int h, long s, int bpp) : data(p), width(w), height(h), stride(s), bytespp(bpp) {}
+
+    bool empty() const { return !data || width<=0 || height<=0; }
+    unsigned char *row(int y) const { return data + y*stride; }
+    unsigned char *pixel(int x, int y) const { return row(y) + x*bytespp; }
+    TGAColor get(int x, int y) const { return TGAColor(pixel(x, y), bytespp); }
+    void set(int x, int y, const TGAColor &c) const { for (int i=0; i<bytespp; i++) pixel(x, y)[i] = c.bgra[i]; }
+    ImageView sub(int x, int y, int w, int h) const; // clipped to this view
+    void fill(const TGAColor &c) const;
+    bool copy_from(const ImageView &src) const; // same size and format
+};
+
+class MappedFile;
+
 class TGAImage {
 protected:
     unsigned char* data;
     int width;
     int height;
     int bytespp;
-
-    bool   load_rle_data(std::ifstream &in);
-    bool unload_rle_data(std::ofstream &out);
+    // uncompressed files may be mapped instead of read: data then points into
+    // the read-only mapping, shared by copies
+    std::shared_ptr<MappedFile> mapping;
+    // set by adopt(): data belongs to the caller and is handed back through the deleter
+    std::shared_ptr<unsigned char> external;
+    // orientation is metadata: the file origin and flip_*() only toggle these,
+    // get/set/samplers and the writer honour them, pixels move only in normalize()
+    bool flipped_x;
+    bool flipped_y;
+
+    bool   load_rle_data(const unsigned char *in, unsigned long nbytes);
+    unsigned long unload_rle_data(const unsigned char *pixels, unsigned long npixels, unsigned char *out);
+    bool map_tga_file(const char *filename, const TGA_Header &header);
+    unsigned char *pixel(int x, int y);
+    bool detach(); // writable copy of mapped pixels
+    void reverse_rows();
+    void reverse_columns();
+    void release();
 public:
     enum Format {
         GRAYSCALE=1, RGB=3, RGBA=4
     };
+    enum { ALIGNMENT=64 }; // of the start of pixel storage allocated by the image, not of every row
+
 
     TGAImage();
     TGAImage(int w, int h, int bpp);
     TGAImage(const TGAImage &img);
-    bool read_tga_file(const char *filename);
+    TGAImage(TGAImage &&img);
+    bool read_tga_file(const char *filename, bool map=false); // map: zero-copy for uncompressed files
+    bool mapped();
     bool write_tga_file(const char *filename, bool rle=true);
+    void encode_tga(std::vector<unsigned char> &file, bool rle=true); // the file contents, in memory
     bool flip_horizontally();
     bool flip_vertically();
+    bool flipped_horizontally();
+    bool flipped_vertically();
+    bool normalize(); // physically apply the flips, buffer() does it
     bool scale(int w, int h);
     TGAColor get(int x, int y);
     bool set(int x, int y, TGAColor &c);
     bool set(int x, int y, const TGAColor &c);
     ~TGAImage();
     TGAImage & operator =(const TGAImage &img);
+    TGAImage & operator =(TGAImage &&img);
+    // wraps pixels without copying them (top-down rows, no padding); deleter
+    // runs when the image lets go of them, none means the caller keeps ownership
+    void adopt(unsigned char *pixels, int w, int h, int bpp, std::function<void(unsigned char *)> deleter=nullptr);
     int get_width();
     int get_height();
     int get_bytespp();
     unsigned char *buffer();
+    // writable views: mapped pixels are detached first, horizontal flips are
+    // applied to the pixels, vertical ones become a negative stride
+    ImageView view();
+    ImageView view(int x, int y, int w, int h);
+    ImageView read_view(); // must not be written through, mapped pixels stay mapped
     void clear();
 };
 
@@ -0,0 +1,70 @@
+#include <algorithm>
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int nthreads) : workers_(), tasks_(), mutex_(), cv_(), stop_(false) {
+    if (nthreads<=0) nthreads = (int)std::thread::hardware_concurrency();
+    if (nthreads<=0) nthreads = 2;
+    for (int i=0; i<nthreads; i++)
+        workers_.emplace_back(&ThreadPool::worker_loop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (size_t i=0; i<workers_.size(); i++) workers_[i].join();
+}
+
+int ThreadPool::size() {
+    return (int)workers_.size();
+}
+
+void ThreadPool::worker_loop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+            if (stop_ && tasks_.empty()) return;
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallel_for(int n, const std::function<void(int)> &fn) {
+    if (n<=0) return;
+    struct State {
+        std::atomic<int> next;
+        std::atomic<int> done;
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+    std::shared_ptr<State> st = std::make_shared<State>();
+    st->next = 0;
+    st->done = 0;
+    const std::function<void(int)> *body = &fn; // only dereferenced while the caller waits below
+    auto run = [st, body, n]() {
+        int i;
+        while ((i = st->next++)<n) {
+            (*body)(i);
+            if (++st->done==n) {
+                std::lock_guard<std::mutex> lock(st->mutex);
+                st->cv.notify_all();
+            }
+        }
+    };
+    int helpers = std::min(size(), n) - 1;
+    for (int i=0; i<helpers; i++) submit(run);
+    run();
+    std::unique_lock<std::mutex> lock(st->mutex);
+    st->cv.wait(lock, [&st, n]() { return st->done==n; });
+}
+
+ThreadPool &ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,48 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+
+// Fixed-size pool of worker threads shared by the whole renderer
+// (texture decoding, mesh preprocessing, ...).
+class ThreadPool {
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()> > tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stop_;
+    void worker_loop();
+public:
+    ThreadPool(int nthreads=0); // 0 means one thread per hardware core
+    ~ThreadPool();
+    int size();
+
+    template<class F> std::future<decltype(std::declval<F>()())> submit(F f) {
+        typedef decltype(f()) R;
+        auto task = std::make_shared<std::packaged_task<R()> >(std::move(f));
+        std::future<R> res = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push([task]() { (*task)(); });
+        }
+        cv_.notify_one();
+        return res;
+    }
+
+    // runs fn(0..n-1) on the pool and waits; the calling thread takes part,
+    // so it is safe to call from inside a pool task
+    void parallel_for(int n, const std::function<void(int)> &fn);
+
+    static ThreadPool &instance();
+};
+
+#endif //__THREADPOOL_H__
@@ -0,0 +1,127 @@
+#include <cmath>
+#include <algorithm>
+#include "vcache.h"
+
+namespace {
+
+const int   kCacheSize         = 32;
+const float kCacheDecayPower   = 1.5f;
+const float kLastTriScore      = 0.75f;
+const float kValenceBoostScale = 2.0f;
+const float kValenceBoostPower = 0.5f;
+
+float vertex_score(int cache_pos, int remaining) {
+    if (remaining<=0) return -1.f; // no triangle needs it any more
+    float score = 0.f;
+    if (cache_pos>=0) {
+        if (cache_pos<3) {
+            score = kLastTriScore; // used by the last triangle, no matter which of the three
+        } else {
+            float scaler = 1.f/(kCacheSize-3);
+            score = std::pow(1.f-(cache_pos-3)*scaler, kCacheDecayPower);
+        }
+    }
+    return score + kValenceBoostScale*std::pow((float)remaining, -kValenceBoostPower);
+}
+
+}
+
+void optimize_vertex_cache(std::vector<Vec3i> &faces, int nverts) {
+    int nfaces = (int)faces.size()/3;
+    if (nfaces<2) return;
+
+    // vertex -> triangles adjacency in a flat array
+    std::vector<int> offset(nverts+1, 0), remaining(nverts, 0);
+    for (int i=0; i<nfaces*3; i++) remaining[faces[i][0]]++;
+    for (int v=0; v<nverts; v++) offset[v+1] = offset[v] + remaining[v];
+    std::vector<int> adjacency(offset[nverts]), fill(offset.begin(), offset.end()-1);
+    for (int f=0; f<nfaces; f++)
+        for (int k=0; k<3; k++) adjacency[fill[faces[f*3+k][0]]++] = f;
+
+    std::vector<int> cache_pos(nverts, -1);
+    std::vector<float> vscore(nverts);
+    for (int v=0; v<nverts; v++) vscore[v] = vertex_score(-1, remaining[v]);
+    std::vector<float> tscore(nfaces, 0.f);
+    std::vector<bool> emitted(nfaces, false);
+    for (int f=0; f<nfaces; f++)
+        for (int k=0; k<3; k++) tscore[f] += vscore[faces[f*3+k][0]];
+
+    std::vector<int> cache, next_cache;
+    std::vector<int> order;
+    order.reserve(nfaces);
+    int best = (int)(std::max_element(tscore.begin(), tscore.end())-tscore.begin());
+    int cursor = 0; // next candidate for a full scan when the cache runs dry
+    while ((int)order.size()<nfaces) {
+        if (best<0) {
+            // no neighbour left in the cache, restart from the best untouched triangle
+            float best_score = -1.f;
+            for (int f=cursor; f<nfaces; f++) {
+                if (emitted[f]) { if (f==cursor) cursor++; continue; }
+                if (tscore[f]>best_score) { best_score = tscore[f]; best = f; }
+            }
+        }
+        emitted[best] = true;
+        order.push_back(best);
+
+        // the triangle's vertices go to the front of the LRU cache
+        next_cache.clear();
+        for (int k=0; k<3; k++) {
+            int v = faces[best*3+k][0];
+            next_cache.push_back(v);
+            for (int i=offset[v]; i<offset[v+1]; i++)
+                if (adjacency[i]==best) { std::swap(adjacency[i], adjacency[offset[v]+remaining[v]-1]); break; }
+            remaining[v]--;
+        }
+        for (size_t i=0; i<cache.size(); i++)
+            if (std::find(next_cache.begin(), next_cache.end(), cache[i])==next_cache.end()) next_cache.push_back(cache[i]);
+        for (size_t i=0; i<next_cache.size(); i++) cache_pos[next_cache[i]] = i<kCacheSize ? (int)i : -1;
+
+        // rescore the vertices whose cache position changed, the ones that fell out included
+        for (size_t i=0; i<next_cache.size(); i++) {
+            int v = next_cache[i];
+            float s = vertex_score(cache_pos[v], remaining[v]);
+            float delta = s - vscore[v];
+            vscore[v] = s;
+            for (int j=offset[v]; j<offset[v]+remaining[v]; j++) tscore[adjacency[j]] += delta;
+        }
+        if ((int)next_cache.size()>kCacheSize) next_cache.resize(kCacheSize);
+        cache.swap(next_cache);
+
+        // pick the best triangle touching the cache
+        best = -1;
+        float best_score = -1.f;
+        for (size_t i=0; i<cache.size(); i++) {
+            int v = cache[i];
+            for (int j=offset[v]; j<offset[v]+remaining[v]; j++) {
+                int f = adjacency[j];
+                if (tscore[f]>best_score) { best_score = tscore[f]; best = f; }
+            }
+        }
+    }
+
+    std::vector<Vec3i> sorted(faces.size());
+    for (int i=0; i<nfaces; i++)
+        for (int k=0; k<3; k++) sorted[i*3+k] = faces[order[i]*3+k];
+    faces.swap(sorted);
+}
+
+VertexCacheStats analyze_vertex_cache(const std::vector<Vec3i> &faces, int nverts, int cache_size) {
+    VertexCacheStats stats;
+    stats.acmr = stats.atvr = 0.f;
+    int nfaces = (int)faces.size()/3;
+    if (!nfaces) return stats;
+    std::vector<unsigned int> timestamp(nverts, 0); // time the vertex entered the fifo, 0 means not cached
+    std::vector<bool> used(nverts, false);
+    unsigned int now = 0;
+    int misses = 0, unique = 0;
+    for (size_t i=0; i<faces.size(); i++) {
+        int v = faces[i][0];
+        if (!used[v]) { used[v] = true; unique++; }
+        if (timestamp[v] && now-timestamp[v]<(unsigned int)cache_size) continue; // hit
+        misses++;
+        timestamp[v] = ++now;
+    }
+    stats.acmr = (float)misses/nfaces;
+    stats.atvr = (float)misses/unique;
+    return stats;
+}
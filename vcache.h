@@ -0,0 +1,21 @@
+#ifndef __VCACHE_H__
+#define __VCACHE_H__
+
+#include <vector>
+#include "geometry.h"
+
+// Triangle order optimisation for post-transform vertex cache reuse
+// (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation", 2006).
+// faces is a Model style triangle index buffer (vertex/uv/normal corners);
+// triangles are reordered in place, corners keep their winding.
+void optimize_vertex_cache(std::vector<Vec3i> &faces, int nverts);
+
+struct VertexCacheStats {
+    float acmr; // average cache miss ratio: transformed vertices per triangle, 0.5 is ideal
+    float atvr; // average transformed vertex ratio: transformed per distinct vertex, 1 is ideal
+};
+
+// simulates a FIFO post-transform cache of the given size
+VertexCacheStats analyze_vertex_cache(const std::vector<Vec3i> &faces, int nverts, int cache_size=16);
+
+#endif //__VCACHE_H__
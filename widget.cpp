@@ -2,6 +2,12 @@
 #include "./ui_widget.h"
 #include <bits/stdc++.h>
 #include "gl.h"
+#include "modelregistry.h"
+#include "scene.h"
+#include "streammesh.h"
+#include "framebuffer.h"
+#include "framewriter.h"
+#include "renderworker.h"
 
 int width  = 800;
 int height = 800; //const int depth = 255; //as default
@@ -22,172 +28,224 @@ NormalShader normalShader;
 PhoneShader phoneShader;
 LighterPhoneShader lighterPhoneShader;
 
-Model model0 = Model("obj/african_head/african_head.obj");
-Model model1 = Model("obj/boggie/body.obj");
-Model model2 = Model("obj/diablo3_pose/diablo3_pose.obj");
-Model *model = &model0;
+// models are parsed on first selection, see Widget::selectModel
+ModelRegistry modelRegistry;
+Scene scene;
+Model *model = nullptr; // the mesh being drawn, read by the shaders
 IShader *shader = &phoneShader;
 
+// every cboxModel entry is a character made of one or more obj files
+const std::vector<std::vector<const char *> > characterFiles = {
+    {"obj/african_head/african_head.obj", "obj/african_head/african_head_eye_inner.obj", "obj/african_head/african_head_eye_outer.obj"},
+    {"obj/boggie/body.obj", "obj/boggie/head.obj", "obj/boggie/eyes.obj"},
+    {"obj/diablo3_pose/diablo3_pose.obj"},
+};
+std::vector<std::vector<int> > characterParts; // registry ids of characterFiles
+StreamingMesh *streamMesh = nullptr; // set by --stream, replaces the scene
+Framebuffer framebuffer; // reused by every Render call
+ToneMap toneMap = TONEMAP_CLAMP; // HDR resolve of every frame, clamp keeps LDR shaders byte-identical (--tonemap)
+float exposure = 1.f;
+FrameWriter frameWriter; // saves output.tga and zbuffer.tga off the GUI thread
+bool saveFrames = false; // the GUI gets frames in memory, disk output is opt-in (--save-frames)
+bool compressModels = false; // see Model::compress, set before the Widget is created
+bool cullBackfaces = false; // cone culling for open meshes too (--cull-backfaces), closed ones always get it
+RenderWorker renderWorker; // owns everything above once the window is up, see Widget::requestRender
+
+//conservative: false only when all corners are on the same side outside the screen
+static bool boxOnScreen(Vec3f bmin, Vec3f bmax, Matrix M) {
+    int outside[4] = {0, 0, 0, 0};
+    for (int c=0; c<8; c++) {
+        Vec3f p(c&1 ? bmax.x : bmin.x, c&2 ? bmax.y : bmin.y, c&4 ? bmax.z : bmin.z);
+        Vec4f q = M*embed<4>(p);
+        if (q[3] <= 0) return true;
+        float x = q[0]/q[3], y = q[1]/q[3];
+        outside[0] += x < 0;
+        outside[1] += x >= width;
+        outside[2] += y < 0;
+        outside[3] += y >= height;
+    }
+    return outside[0]<8 && outside[1]<8 && outside[2]<8 && outside[3]<8;
+}
+
+//chunks are mapped a piece at a time into one transient model, nothing stays resident
+static bool drawStream(StreamingMesh &mesh, IShader *shader, HdrImage &image, TGAImage &zbuffer, const std::atomic<bool> *cancel) {
+    Model piece;
+    model = &piece;
+    shader->uniform_M =  Projection*ModelView;
+    shader->uniform_MIT = (Projection*ModelView).invert_transpose();
+    Matrix M = Viewport*Projection*ModelView;
+    int step = mesh.max_tris_per_load();
+    int drawn = 0;
+    mesh.reset_bytes_streamed();
+    for (int c=0; c<mesh.nchunks(); c++) {
+        const StreamingMesh::Chunk &chunk = mesh.chunk(c);
+        if (!boxOnScreen(chunk.bmin, chunk.bmax, M)) continue;
+        for (int first=0; first<chunk.ntris; first+=step) {
+            if (cancel && *cancel) break;
+            if (!mesh.load(c, first, std::min(step, chunk.ntris-first), piece)) continue;
+            for (int i=0; i<piece.nfaces(); i++) {
+                Vec4f screen_coords[3];
+                for (int j = 0; j < 3; j++) {
+                    screen_coords[j] = shader->vertex(i, j);
+                }
+                drawTriangle(screen_coords, shader, image, zbuffer);
+            }
+            drawn++;
+        }
+    }
+    model = nullptr;
+    if (cancel && *cancel) return false;
+    qDebug() << "streamed" << drawn << "pieces" << mesh.bytes_streamed() << "bytes";
+    return true;
+}
+
 
-void Render(Model *model, IShader *shader) {
-    TGAImage image(width, height, TGAImage::RGB);
-    TGAImage zbuffer(width, height, TGAImage::GRAYSCALE);
+//false if cancel was raised before the frame was finished, the framebuffer then holds a partial frame
+bool Render(Scene &scene, IShader *shader, const std::atomic<bool> *cancel) {
+    if (!scene.size() && !streamMesh) return true; // still loading
+    framebuffer.resize(width, height);
+    framebuffer.clear();
+    TGAImage &image = framebuffer.color();
+    TGAImage &zbuffer = framebuffer.depth();
+    HdrImage &hdr = framebuffer.hdr(); //shaders write linear light, clamped once in the resolve
+    //y runs up the screen: store rows bottom-up so memory order is display order (a flag, no pixels move)
+    if (!image.flipped_vertically()) image.flip_vertically();
+    if (!zbuffer.flipped_vertically()) zbuffer.flip_vertically();
     lookat(eye, center, up);
     viewport(width/8, height/8, width*3/4, height*3/4);
     projection(eye, center);
     light_dir.normalize();
 
-    shader->uniform_M =  Projection*ModelView;
-    shader->uniform_MIT = (Projection*ModelView).invert_transpose();
-    int cnt = 0;
-    for (int i=0; i<model->nfaces(); i++) {
-        std::vector<int> face = model->face(i);
-        Vec3f world_coords[3];
-        Vec4f screen_coords[3];
-        for (int j = 0; j < 3; j++) {
-            Vec3f v = model->vert(face[j]);
-            world_coords[j] = v;
-            screen_coords[j] = shader->vertex(i, j);
+    Matrix view = ModelView;
+    Vec3f world_light = light_dir;
+    std::vector<int> visible;
+    bool done = !streamMesh || drawStream(*streamMesh, shader, hdr, zbuffer, cancel);
+    scene.sort(shader);
+    for (int k=0; done && k<scene.size(); k++) {
+        SceneObject &obj = scene.object(k);
+        IShader *objShader = obj.shader ? obj.shader : shader;
+        model = obj.mesh.get();
+        model->touch_textures();
+        ModelView = view*obj.transform;
+        //shaders light in object space, fine for rigid transforms
+        light_dir = proj<3>(obj.transform.transpose()*embed<4>(world_light, 0.f)).normalize();
+        objShader->uniform_M =  Projection*ModelView;
+        objShader->uniform_MIT = (Projection*ModelView).invert_transpose();
+        //fewer triangles when the mesh covers few pixels
+        Matrix M = Viewport*Projection*ModelView;
+        float extent = screenExtent(model->bbox_min(), model->bbox_max(), M);
+        model->set_lod(model->lod_for_screen_size(extent));
+        //whole clusters facing away or off screen are dropped before any per-triangle work
+        Vec4f camera = ModelView.invert()*embed<4>(Vec3f(0, 0, (eye-center).norm()));
+        model->cull_meshlets(proj<3>(camera/camera[3]), M, width, height, visible, cullBackfaces || model->closed());
+        for (size_t f=0; f<visible.size(); f++) {
+            //polled about once per cluster, a superseded frame stops within a few hundred triangles
+            if ((f&127)==0 && cancel && *cancel) {
+                done = false;
+                break;
+            }
+            int i = visible[f];
+            Vec4f screen_coords[3];
+            for (int j = 0; j < 3; j++) {
+                screen_coords[j] = objShader->vertex(i, j);
+            }
+            drawTriangle(screen_coords, objShader, hdr, zbuffer);
         }
-        drawTriangle(screen_coords, shader, image, zbuffer);
-        //printf("%d ok\n", ++cnt);
     }
+    ModelView = view;
+    light_dir = world_light;
+    model = nullptr;
+    if (!done) return false;
+    resolve(hdr, image.view(), toneMap, exposure);
 
     // image.flip_vertically();
     // zbuffer.flip_vertically();
-    bool okwrite = image.write_tga_file("output.tga");
-    qDebug() << "okwrite" << okwrite;
-    zbuffer.write_tga_file("zbuffer.tga");
+    if (!saveFrames) return true;
+    //the framebuffer stays for the view, the writer thread gets a copy in a recycled image
+    TGAImage frame = frameWriter.spare(image.get_width(), image.get_height(), image.get_bytespp());
+    TGAImage depth = frameWriter.spare(zbuffer.get_width(), zbuffer.get_height(), zbuffer.get_bytespp());
+    frame.view().copy_from(image.view());
+    depth.view().copy_from(zbuffer.view());
+    frame.flip_vertically(); //files keep row 0 at the top, the framebuffer at the bottom
+    depth.flip_vertically();
+    frameWriter.submit(std::move(frame), "output.tga"); //format follows the extension, see imagewriter.h
+    frameWriter.submit(std::move(depth), "zbuffer.tga");
+    return true;
 }
 
-QImage loadTga(const char* filePath, bool &success)
-{
-    QImage img;
-    if (!img.load(filePath))
-    {
+//which face of which scene object is seen through framebuffer pixel (x, y), -1 for none
+int Pick(Scene &scene, int x, int y, int &object, Vec2f &uv) {
+    lookat(eye, center, up);
+    viewport(width/8, height/8, width*3/4, height*3/4);
+    projection(eye, center);
+    Matrix view = ModelView;
+    int face = -1;
+    float bestDepth = -std::numeric_limits<float>::max();
+    for (int k=0; k<scene.size(); k++) {
+        SceneObject &obj = scene.object(k);
+        Matrix M = Viewport*Projection*view*obj.transform;
+        Matrix Minv = M.invert();
+        //cast from the near end of the depth range towards the far end, in object space
+        Vec4f nearPt = Minv*embed<4>(Vec3f(x+.5f, y+.5f, 255.f));
+        Vec4f farPt  = Minv*embed<4>(Vec3f(x+.5f, y+.5f, 0.f));
+        Vec3f orig = proj<3>(nearPt/nearPt[3]);
+        Vec3f dir = proj<3>(farPt/farPt[3]) - orig;
+        Vec2f hitUv;
+        float t;
+        int hit = obj.mesh->pick(orig, dir, hitUv, t);
+        if (hit < 0) continue;
+        Vec4f p = M*embed<4>(orig + dir*t);
+        if (p[2]/p[3] <= bestDepth) continue;
+        bestDepth = p[2]/p[3];
+        face = hit;
+        object = k;
+        uv = hitUv;
+    }
+    return face;
+}
 
-        // open the file
-        std::fstream fsPicture(filePath, std::ios::in | std::ios::binary);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+static const QImage::Format bgrFormat = QImage::Format_BGR888;
+#else
+static const QImage::Format bgrFormat = QImage::Format_RGB888; // BGR888 came with Qt 5.14, rows get swizzled
+#endif
 
-        if (!fsPicture.is_open())
-        {
-            img = QImage(1, 1, QImage::Format_RGB32);
-            img.fill(Qt::red);
-            success = false;
-            return img;
-        }
+//one row of 24-bit TGA pixels (B,G,R in memory) into a bgrFormat scanline
+static void copyBgrRow(uchar *dst, const unsigned char *src, int width)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    memcpy(dst, src, (size_t)width*3);
+#else
+    for (int x = 0; x < width; x++, dst += 3, src += 3) {
+        dst[0] = src[2];
+        dst[1] = src[1];
+        dst[2] = src[0];
+    }
+#endif
+}
 
-        // some variables
-        std::vector<std::uint8_t>* vui8Pixels;
-        std::uint32_t ui32BpP;
-        std::uint32_t ui32Width;
-        std::uint32_t ui32Height;
-
-        // read in the header
-        std::uint8_t ui8x18Header[19] = { 0 };
-        fsPicture.read(reinterpret_cast<char*>(&ui8x18Header), sizeof(ui8x18Header) - 1);
-
-        //get variables
-        vui8Pixels = new std::vector<std::uint8_t>;
-        bool bCompressed;
-        std::uint32_t ui32IDLength;
-        std::uint32_t ui32PicType;
-        std::uint32_t ui32PaletteLength;
-        std::uint32_t ui32Size;
-
-        // extract all information from header
-        ui32IDLength = ui8x18Header[0];
-        ui32PicType = ui8x18Header[2];
-        ui32PaletteLength = ui8x18Header[6] * 0x100 + ui8x18Header[5];
-        ui32Width = ui8x18Header[13] * 0x100 + ui8x18Header[12];
-        ui32Height = ui8x18Header[15] * 0x100 + ui8x18Header[14];
-        ui32BpP = ui8x18Header[16];
-
-        // calculate some more information
-        ui32Size = ui32Width * ui32Height * ui32BpP / 8;
-        bCompressed = ui32PicType == 9 || ui32PicType == 10;
-        vui8Pixels->resize(ui32Size);
-
-        // jump to the data block
-        fsPicture.seekg(ui32IDLength + ui32PaletteLength, std::ios_base::cur);
-
-        if (ui32PicType == 2 && (ui32BpP == 24 || ui32BpP == 32))
-        {
-            fsPicture.read(reinterpret_cast<char*>(vui8Pixels->data()), ui32Size);
-        }
-        // else if compressed 24 or 32 bit
-        else if (ui32PicType == 10 && (ui32BpP == 24 || ui32BpP == 32))	// compressed
-        {
-            std::uint8_t tempChunkHeader;
-            std::uint8_t tempData[5];
-            unsigned int tempByteIndex = 0;
-
-            do {
-                fsPicture.read(reinterpret_cast<char*>(&tempChunkHeader), sizeof(tempChunkHeader));
-
-                if (tempChunkHeader >> 7)	// repeat count
-                {
-                    // just use the first 7 bits
-                    tempChunkHeader = (uint8_t(tempChunkHeader << 1) >> 1);
-
-                    fsPicture.read(reinterpret_cast<char*>(&tempData), ui32BpP / 8);
-
-                    for (int i = 0; i <= tempChunkHeader; i++)
-                    {
-                        vui8Pixels->at(tempByteIndex++) = tempData[0];
-                        vui8Pixels->at(tempByteIndex++) = tempData[1];
-                        vui8Pixels->at(tempByteIndex++) = tempData[2];
-                        if (ui32BpP == 32) vui8Pixels->at(tempByteIndex++) = tempData[3];
-                    }
-                }
-                else						// data count
-                {
-                    // just use the first 7 bits
-                    tempChunkHeader = (uint8_t(tempChunkHeader << 1) >> 1);
-
-                    for (int i = 0; i <= tempChunkHeader; i++)
-                    {
-                        fsPicture.read(reinterpret_cast<char*>(&tempData), ui32BpP / 8);
-
-                        vui8Pixels->at(tempByteIndex++) = tempData[0];
-                        vui8Pixels->at(tempByteIndex++) = tempData[1];
-                        vui8Pixels->at(tempByteIndex++) = tempData[2];
-                        if (ui32BpP == 32) vui8Pixels->at(tempByteIndex++) = tempData[3];
-                    }
-                }
-            } while (tempByteIndex < ui32Size);
-        }
-        // not useable format
-        else
-        {
-            fsPicture.close();
+//any TGA TGAImage reads (types 2/3/10/11, any origin) as a QImage, a red pixel if it can't be read
+QImage loadTga(const char* filePath, bool &success)
+{
+    TGAImage tga;
+    if (!tga.read_tga_file(filePath, true)) { // mapped when uncompressed
+        QImage img;
+        success = img.load(filePath); // whatever else Qt's plugins know
+        if (!success) {
             img = QImage(1, 1, QImage::Format_RGB32);
             img.fill(Qt::red);
-            success = false;
-            return img;
         }
-
-        fsPicture.close();
-
-        img = QImage(ui32Width, ui32Height, QImage::Format_RGB888);
-
-        int pixelSize = ui32BpP == 32 ? 4 : 3;
-        //TODO: write direct into img
-        for (unsigned int x = 0; x < ui32Width; x++)
-        {
-            for (unsigned int y = 0; y < ui32Height; y++)
-            {
-                int valr = vui8Pixels->at(y * ui32Width * pixelSize + x * pixelSize + 2);
-                int valg = vui8Pixels->at(y * ui32Width * pixelSize + x * pixelSize + 1);
-                int valb = vui8Pixels->at(y * ui32Width * pixelSize + x * pixelSize);
-
-                QColor value(valr, valg, valb);
-                img.setPixelColor(x, y, value);
-            }
-        }
-
-        img = img.mirrored();
-
+        return img;
+    }
+    //QImage formats with the TGA byte order (ARGB32 is BGRA in memory on little endian),
+    //so rows are copied as they are, top row first whatever the file origin
+    QImage::Format format = tga.get_bytespp() == TGAImage::GRAYSCALE ? QImage::Format_Grayscale8
+                          : tga.get_bytespp() == TGAImage::RGB ? bgrFormat : QImage::Format_ARGB32;
+    ImageView view = tga.read_view();
+    QImage img(view.width, view.height, format);
+    for (int y = 0; y < view.height; y++) {
+        if (view.bytespp == TGAImage::RGB) copyBgrRow(img.scanLine(y), view.row(y), view.width);
+        else memcpy(img.scanLine(y), view.row(y), (size_t)view.width*view.bytespp);
     }
     success = true;
     return img;
@@ -199,38 +257,83 @@ Widget::Widget(QWidget *parent)
 {
     ui->setupUi(this);
     setStyleSheet("background-color: white;");
-    QImage *img = new QImage;
-    QString imgPath = "./output.tga";
+    modelRegistry.set_compress(compressModels); //quantized attributes, opt-in (--compress-models)
+    for (size_t i = 0; i < characterFiles.size(); i++) {
+        std::vector<int> parts;
+        for (const char *file : characterFiles[i]) parts.push_back(modelRegistry.add(file));
+        characterParts.push_back(parts);
+    }
+    selectModel(ui->cboxModel->currentIndex());
+    ui->label->installEventFilter(this);
     ui->label->setGeometry(200,0,800,600);//前两个参数表示label左上角位置后面分别是宽和高
-    ;
     bool ok = 1;
-    *img = loadTga(imgPath.toStdString().c_str(), ok);
-    //img->scaled(400,300,Qt::KeepAspectRatio);
-    ui->label->setPixmap(QPixmap::fromImage(*img));
-    free(img);
+    ui->label->setPixmap(QPixmap::fromImage(loadTga("./output.tga", ok))); //the last saved frame until the first render
 }
 
-void Widget::updateImg() {
-    QImage *img = new QImage;
-    QString imgPath = "./output.tga";
+//the framebuffer as a QImage of its own, taken on the render thread before the next frame reuses the pixels
+static QImage frameImage() {
+    ImageView frame = framebuffer.color().view();
+    if (frame.empty()) return QImage();
+    //y runs up the screen, the last row is the top one (in memory order too when rows are stored bottom-up, see Render)
+    QImage img(frame.width, frame.height, bgrFormat);
+    for (int y = 0; y < frame.height; y++)
+        copyBgrRow(img.scanLine(y), frame.row(frame.height-1-y), frame.width);
+    return img;
+}
+
+//render the latest state on the worker, a request made meanwhile cancels this one
+void Widget::requestRender() {
+    QPointer<Widget> self(this);
+    renderWorker.request([self](const std::atomic<bool> &cancel) {
+        if (!Render(scene, shader, &cancel)) return false;
+        QImage img = frameImage();
+        if (img.isNull()) return true;
+        QMetaObject::invokeMethod(self, [self, img]() {
+            if (self) self->showFrame(img);
+        }, Qt::QueuedConnection);
+        return true;
+    });
+}
+
+void Widget::showFrame(const QImage &img) {
     ui->label->setGeometry(200,0,800,600);//前两个参数表示label左上角位置后面分别是宽和高
-    ;
-    bool ok = 1;
-    *img = loadTga(imgPath.toStdString().c_str(), ok);
-    //img->scaled(400,300,Qt::KeepAspectRatio);
-    ui->label->setPixmap(QPixmap::fromImage(*img));
-    free(img);
+    ui->label->setPixmap(QPixmap::fromImage(img));
+}
+
+//click on the rendered image to find the face and uv under the mouse
+bool Widget::eventFilter(QObject *obj, QEvent *event)
+{
+    if (obj == ui->label && event->type() == QEvent::MouseButtonPress) {
+        QMouseEvent *me = static_cast<QMouseEvent *>(event);
+        //the pixmap is left aligned and vertically centred, and shown mirrored
+        int x = me->pos().x();
+        int y = height - 1 - (me->pos().y() - (ui->label->height() - height) / 2);
+        //the scene belongs to the render thread, ask there
+        renderWorker.post([x, y]() {
+            int object = -1;
+            Vec2f uv;
+            int face = Pick(scene, x, y, object, uv);
+            qDebug() << "pick" << x << y << "object" << object << "face" << face << "uv" << uv.x << uv.y;
+        });
+    }
+    return QWidget::eventFilter(obj, event);
 }
 
 Widget::~Widget()
 {
+    renderWorker.stop(); // frames still queued for us are dropped by the QPointer
+    frameWriter.flush();
+    //models are owned by globals created before the texture cache, release them while it still exists
+    scene.clear();
+    delete streamMesh;
+    streamMesh = nullptr;
+    modelRegistry.clear();
     delete ui;
 }
 
 void Widget::on_btnRender_clicked()
 {
-    Render(model, shader);
-    updateImg();
+    requestRender();
 }
 
 
@@ -238,38 +341,36 @@ void Widget::on_btnRender_clicked()
 void Widget::on_cboxShader_currentIndexChanged(int index)
 {
     qDebug() << "cboxShader" << index;
-    if (index == 0) shader = &gouraudShader;
-    if (index == 1) shader = &sixColorShader;
-    if (index == 2) shader = &textureShader;
-    if (index == 3) shader = &normalShader;
-    if (index == 4) shader = &phoneShader;
-    if (index == 5) shader = &lighterPhoneShader;
-    Render(model, shader);
-    updateImg();
+    IShader *selected = nullptr;
+    if (index == 0) selected = &gouraudShader;
+    if (index == 1) selected = &sixColorShader;
+    if (index == 2) selected = &textureShader;
+    if (index == 3) selected = &normalShader;
+    if (index == 4) selected = &phoneShader;
+    if (index == 5) selected = &lighterPhoneShader;
+    if (selected) renderWorker.post([selected]() { shader = selected; });
+    requestRender();
 }
 
 
 void Widget::on_sboxEyeX_valueChanged(int arg1)
 {
-    eye.x = arg1;
-    Render(model, shader);
-    updateImg();
+    renderWorker.post([arg1]() { eye.x = arg1; }); //applied between frames, never under a running one
+    requestRender();
 }
 
 
 void Widget::on_sboxEyeY_valueChanged(int arg1)
 {
-    eye.y = arg1;
-    Render(model, shader);
-    updateImg();
+    renderWorker.post([arg1]() { eye.y = arg1; }); //applied between frames, never under a running one
+    requestRender();
 }
 
 
 void Widget::on_sboxEyeZ_valueChanged(int arg1)
 {
-    eye.z = arg1;
-    Render(model, shader);
-    updateImg();
+    renderWorker.post([arg1]() { eye.z = arg1; }); //applied between frames, never under a running one
+    requestRender();
 }
 
 
@@ -279,21 +380,75 @@ void Widget::on_sboxEyeZ_valueChanged(int arg1)
 void Widget::on_cboxModels_currentIndexChanged(int index)
 {
     qDebug() << "cboxModel" << index;
-    if (index == 0) model = &model0;
-    if (index == 1) model = &model1;
-    if (index == 2) model = &model2;
-    Render(model, shader);
-    updateImg();
+    selectModel(index);
 }
 
 
 void Widget::on_cboxModel_currentIndexChanged(int index)
 {
     qDebug() << "cboxModel" << index;
-    if (index == 0) model = &model0;
-    if (index == 1) model = &model1;
-    if (index == 2) model = &model2;
-    Render(model, shader);
-    updateImg();
+    selectModel(index);
 }
 
+
+//load in the background, the frame is rendered once the model arrives
+void Widget::selectModel(int index)
+{
+    if (index < 0 || index >= (int)characterParts.size()) return;
+    modelIndex = index;
+    renderWorker.post([]() {
+        delete streamMesh; // back to the in-memory characters
+        streamMesh = nullptr;
+    });
+    QPointer<Widget> self(this);
+    for (int id : characterParts[index]) {
+        modelRegistry.request(id, [self, index](std::shared_ptr<Model>) {
+            QMetaObject::invokeMethod(self, [self, index]() {
+                if (self) self->onModelLoaded(index);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+
+void Widget::onModelLoaded(int index)
+{
+    if (index != modelIndex) return; // the user picked another model meanwhile
+    for (int id : characterParts[index])
+        if (!modelRegistry.loaded(id)) return; // wait for the remaining parts
+    Scene next;
+    for (int id : characterParts[index]) next.add(modelRegistry.get(id));
+    renderWorker.post([next]() {
+        scene = next;
+        modelRegistry.trim(6); // keep the previous character around for quick switching back
+    });
+    requestRender();
+}
+
+
+
+//render an obj too large for memory, converting it to <obj>.bbsm on first use or when the obj changed
+//the conversion runs on the render thread, the window stays responsive meanwhile
+void Widget::openStream(const char *objfile, size_t memory_limit)
+{
+    modelIndex = -1; // ignore characters still loading
+    std::string obj = objfile;
+    renderWorker.post([obj, memory_limit]() {
+        std::string converted = obj + ".bbsm";
+        if (!StreamingMesh::up_to_date(obj.c_str(), converted.c_str()) &&
+            !StreamingMesh::convert(obj.c_str(), converted.c_str(), memory_limit)) {
+            qDebug() << "can't stream" << obj.c_str();
+            return;
+        }
+        StreamingMesh *mesh = new StreamingMesh;
+        if (!mesh->open(converted.c_str(), memory_limit)) {
+            qDebug() << "can't stream" << obj.c_str();
+            delete mesh;
+            return;
+        }
+        delete streamMesh;
+        streamMesh = mesh;
+        scene.clear();
+    });
+    requestRender();
+}
@@ -3,7 +3,11 @@
 #include <QWidget>
 #include <QImage>
 #include <QImageReader>
+#include <QPointer>
+#include <QMouseEvent>
+#include <atomic>
 #include "gl.h"
+#include "scene.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -15,8 +19,13 @@ extern Matrix ModelView, Projection, Viewport;
 extern Model *model;
 extern Vec3f light_dir, eye, center, up;
 extern int width, height;
+extern bool saveFrames;
+extern bool compressModels;
+extern bool cullBackfaces;
+extern ToneMap toneMap;
 
-void Render(Model *model, IShader &shader);
+bool Render(Scene &scene, IShader *shader, const std::atomic<bool> *cancel = nullptr);
+int Pick(Scene &scene, int x, int y, int &object, Vec2f &uv);
 
 class Widget : public QWidget
 {
@@ -25,8 +34,11 @@ class Widget : public QWidget
 public:
     Widget(QWidget *parent = nullptr);
     ~Widget();
-    void updateImg();
+    void requestRender();
+    void openStream(const char *objfile, size_t memory_limit);
 
+protected:
+    bool eventFilter(QObject *obj, QEvent *event) override;
 
 private slots:
     void on_btnRender_clicked();
@@ -44,6 +56,11 @@ private slots:
     void on_cboxModels_currentIndexChanged(int index);
 
 private:
+    void selectModel(int index);
+    void onModelLoaded(int index);
+    void showFrame(const QImage &img);
+
     Ui::Widget *ui;
+    int modelIndex = 0;
 };
 